@@ -0,0 +1,51 @@
+//*****************************************************************************
+// FILE:            WinMTRCanvas.h
+//
+// DESCRIPTION:     Drawing surface the graph is rendered onto. GDI+ draws it
+//                  in the window, WinMTRRaster into an in-memory image
+//                  without a display.
+//
+//*****************************************************************************
+
+#ifndef WINMTRCANVAS_H_
+#define WINMTRCANVAS_H_
+
+// Colors are 0xAARRGGBB, the same as a GDI+ ARGB
+#define CANVAS_ARGB(a, r, g, b) (((unsigned int)(a) << 24) | ((unsigned int)(r) << 16) | ((unsigned int)(g) << 8) | (unsigned int)(b))
+#define CANVAS_RGB(r, g, b) CANVAS_ARGB(255, r, g, b)
+
+#define CANVAS_ALIGN_NEAR 0
+#define CANVAS_ALIGN_CENTER 1
+#define CANVAS_ALIGN_FAR 2
+
+struct s_canvaspoint {
+    float x;
+    float y;
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRCanvas
+//
+// The primitives the graph needs: filled rectangles, antialiased lines of a
+// given width, single line text in a box and a rectangular clip.
+//*****************************************************************************
+class WinMTRCanvas
+{
+public:
+    virtual ~WinMTRCanvas() {}
+
+    virtual void FillRect(int x, int y, int width, int height, unsigned int color) = 0;
+    virtual void DrawLine(float x0, float y0, float x1, float y1, float width, unsigned int color) = 0;
+    // Connected segments with round joins
+    virtual void DrawLines(const s_canvaspoint* points, int count, float width, unsigned int color) = 0;
+    // Text in the box, size in points, cut off at the box
+    virtual void DrawString(const char* text, float x, float y, float width, float height,
+                            int size, int align, int valign, unsigned int color) = 0;
+    // Text reading upwards, centered on y with its top facing x
+    virtual void DrawStringUp(const char* text, float x, float y, int size, unsigned int color) = 0;
+
+    virtual void SetClip(int x, int y, int width, int height) = 0;
+    virtual void ResetClip() = 0;
+};
+
+#endif // WINMTRCANVAS_H_
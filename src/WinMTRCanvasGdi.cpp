@@ -0,0 +1,78 @@
+//*****************************************************************************
+// FILE:            WinMTRCanvasGdi.cpp
+//
+// DESCRIPTION:     GDI+ implementation of WinMTRCanvas
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRCanvasGdi.h"
+#include <vector>
+
+using namespace Gdiplus;
+
+static StringAlignment ToAlignment(int align)
+{
+    if (align == CANVAS_ALIGN_CENTER) return StringAlignmentCenter;
+    if (align == CANVAS_ALIGN_FAR) return StringAlignmentFar;
+    return StringAlignmentNear;
+}
+
+void WinMTRCanvasGdi::FillRect(int x, int y, int width, int height, unsigned int color)
+{
+    SolidBrush brush(Color((ARGB)color));
+    m_graphics.FillRectangle(&brush, x, y, width, height);
+}
+
+void WinMTRCanvasGdi::DrawLine(float x0, float y0, float x1, float y1, float width, unsigned int color)
+{
+    Pen pen(Color((ARGB)color), width);
+    m_graphics.DrawLine(&pen, x0, y0, x1, y1);
+}
+
+void WinMTRCanvasGdi::DrawLines(const s_canvaspoint* points, int count, float width, unsigned int color)
+{
+    if (count < 2) return;
+    Pen pen(Color((ARGB)color), width);
+    pen.SetLineJoin(LineJoinRound);
+
+    std::vector<PointF> gdiPoints(count);
+    for (int i = 0; i < count; i++) {
+        gdiPoints[i] = PointF(points[i].x, points[i].y);
+    }
+    m_graphics.DrawLines(&pen, &gdiPoints[0], (INT)count);
+}
+
+void WinMTRCanvasGdi::DrawString(const char* text, float x, float y, float width, float height,
+                                 int size, int align, int valign, unsigned int color)
+{
+    Font font(L"Arial", (REAL)size);
+    StringFormat format;
+    format.SetAlignment(ToAlignment(align));
+    format.SetLineAlignment(ToAlignment(valign));
+    SolidBrush textBrush(Color((ARGB)color));
+
+    CString label = text;
+    CT2W wLabel(label);
+    RectF rect(x, y, width, height);
+    m_graphics.DrawString(wLabel, -1, &font, rect, &format, &textBrush);
+}
+
+void WinMTRCanvasGdi::DrawStringUp(const char* text, float x, float y, int size, unsigned int color)
+{
+    GraphicsState state = m_graphics.Save();
+    m_graphics.TranslateTransform(x, y);
+    m_graphics.RotateTransform(-90);
+    DrawString(text, -100, 0, 200, (REAL)(2 * size + 2), size, CANVAS_ALIGN_CENTER, CANVAS_ALIGN_NEAR, color);
+    m_graphics.Restore(state);
+}
+
+void WinMTRCanvasGdi::SetClip(int x, int y, int width, int height)
+{
+    m_graphics.SetClip(Rect(x, y, width, height));
+}
+
+void WinMTRCanvasGdi::ResetClip()
+{
+    m_graphics.ResetClip();
+}
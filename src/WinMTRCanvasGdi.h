@@ -0,0 +1,32 @@
+//*****************************************************************************
+// FILE:            WinMTRCanvasGdi.h
+//
+// DESCRIPTION:     WinMTRCanvas drawing through a GDI+ Graphics object
+//
+//*****************************************************************************
+
+#ifndef WINMTRCANVASGDI_H_
+#define WINMTRCANVASGDI_H_
+
+#include <gdiplus.h>
+#include "WinMTRCanvas.h"
+
+class WinMTRCanvasGdi : public WinMTRCanvas
+{
+public:
+    WinMTRCanvasGdi(Gdiplus::Graphics& graphics) : m_graphics(graphics) {}
+
+    virtual void FillRect(int x, int y, int width, int height, unsigned int color);
+    virtual void DrawLine(float x0, float y0, float x1, float y1, float width, unsigned int color);
+    virtual void DrawLines(const s_canvaspoint* points, int count, float width, unsigned int color);
+    virtual void DrawString(const char* text, float x, float y, float width, float height,
+                            int size, int align, int valign, unsigned int color);
+    virtual void DrawStringUp(const char* text, float x, float y, int size, unsigned int color);
+    virtual void SetClip(int x, int y, int width, int height);
+    virtual void ResetClip();
+
+private:
+    Gdiplus::Graphics& m_graphics;
+};
+
+#endif // WINMTRCANVASGDI_H_
@@ -0,0 +1,32 @@
+//*****************************************************************************
+// FILE:            WinMTRConsole.cpp
+//
+//
+// DESCRIPTION:
+//   Entry point of the console build on Linux, which has the headless modes
+//   only. --daemon runs the monitor, anything else is a --report.
+//
+// NOTES:
+//   The arguments are joined into the command line WinMTRMain gets on
+//   Windows, so both parse the options the same way.
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRHeadless.h"
+
+#ifndef _WIN32
+
+int main(int argc, char* argv[])
+{
+	std::string cmd;
+	for(int i=1; i<argc; ++i) {
+		cmd += argv[i];
+		cmd += " ";
+	}
+	if(GetParamValue(cmd.c_str(), "daemon",'d', NULL))
+		return DaemonMain(cmd.c_str());
+	return ReportMain(cmd.c_str());
+}
+
+#endif // ifndef _WIN32
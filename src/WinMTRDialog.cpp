@@ -9,6 +9,8 @@
 #include "WinMTROptions.h"
 #include "WinMTRProperties.h"
 #include "WinMTRNet.h"
+#include "WinMTRReport.h"
+#include "WinMTRResolver.h"
 #include <iostream>
 #include <sstream>
 
@@ -49,6 +51,7 @@ BEGIN_MESSAGE_MAP(WinMTRDialog, CDialog)
 	ON_CBN_SELCHANGE(IDC_COMBO_TIMESPAN, OnTimeSpanChange)
 	ON_NOTIFY(NM_DBLCLK, IDC_LIST_MTR, OnDblclkList)
 	ON_NOTIFY(NM_CLICK, IDC_LIST_MTR, OnClickList)
+	ON_MESSAGE(WM_WINMTR_RESOLVED, OnHostResolved)
 	ON_CBN_SELCHANGE(IDC_COMBO_HOST, &WinMTRDialog::OnCbnSelchangeComboHost)
 	ON_CBN_SELENDOK(IDC_COMBO_HOST, &WinMTRDialog::OnCbnSelendokComboHost)
 	ON_CBN_CLOSEUP(IDC_COMBO_HOST, &WinMTRDialog::OnCbnCloseupComboHost)
@@ -83,13 +86,17 @@ WinMTRDialog::WinMTRDialog(CWnd* pParent)
 	hasUseIPv6FromCmdLine = false;
 	
 	traceThreadMutex = CreateMutex(NULL, FALSE, NULL);
-	wmtrnet = new WinMTRNet(this);
+	wmtrnet = new WinMTRNet();
+	path.count = 0;
+	resolving = false;
+	memset(&target, 0, sizeof(target));
 	if(!wmtrnet->hasIPv6) m_checkIPv6.EnableWindow(FALSE);
 	useIPv6=2;
 }
 
 WinMTRDialog::~WinMTRDialog()
 {
+	WinMTRResolver::Shared().Cancel(this);
 	delete wmtrnet;
 	CloseHandle(traceThreadMutex);
 }
@@ -129,6 +136,7 @@ BOOL WinMTRDialog::OnInitDialog()
 {
 	CDialog::OnInitDialog();
 	if(!wmtrnet->initialized) {
+		AfxMessageBox(wmtrnet->error.c_str());
 		EndDialog(-1);
 		return TRUE;
 	}
@@ -483,28 +491,34 @@ void WinMTRDialog::OnDblclkList(NMHDR* /*pNMHDR*/, LRESULT* pResult)
 			int nItem = m_listMTR.GetNextSelectedItem(pos);
 			WinMTRProperties wmtrprop;
 			
-			union {sockaddr* addr; sockaddr_in* addr4; sockaddr_in6* addr6;};
-			addr=wmtrnet->GetAddr(nItem);
-			if(!(addr4->sin_family==AF_INET&&addr4->sin_addr.s_addr) && !(addr6->sin6_family==AF_INET6&&(addr6->sin6_addr.u.Word[0]|addr6->sin6_addr.u.Word[1]|addr6->sin6_addr.u.Word[2]|addr6->sin6_addr.u.Word[3]|addr6->sin6_addr.u.Word[4]|addr6->sin6_addr.u.Word[5]|addr6->sin6_addr.u.Word[6]|addr6->sin6_addr.u.Word[7]))) {
+			// the list was filled from path, show the row as it was displayed
+			if(nItem >= path.count) return;
+			const s_hopsnapshot& hop = path.hop[nItem];
+			if(!(hop.addr.sin_family==AF_INET&&hop.addr.sin_addr.s_addr) && !(hop.addr6.sin6_family==AF_INET6&&!IN6_IS_ADDR_UNSPECIFIED(&hop.addr6.sin6_addr))) {
 				strcpy(wmtrprop.host,"");
 				strcpy(wmtrprop.ip,"");
-				wmtrnet->GetName(nItem, wmtrprop.comment);
+				strcpy(wmtrprop.comment, hop.name);
 			} else {
-				wmtrnet->GetName(nItem, wmtrprop.host);
-				if(getnameinfo(addr,sizeof(sockaddr_in6),wmtrprop.ip,40,NULL,0,NI_NUMERICHOST)) {
+				// the name may have been resolved since the list was drawn, or in an earlier session
+				char name[NI_MAXHOST];
+				if(WinMTRResolver::Shared().Lookup((const sockaddr*)&hop.addr6, name) && *name && strlen(name) < sizeof(wmtrprop.host))
+					strcpy(wmtrprop.host, name);
+				else
+					strcpy(wmtrprop.host, hop.name);
+				if(getnameinfo((const sockaddr*)&hop.addr6,sizeof(sockaddr_in6),wmtrprop.ip,40,NULL,0,NI_NUMERICHOST)) {
 					*wmtrprop.ip='\0';
 				}
 				strcpy(wmtrprop.comment, "Host alive.");
 			}
 			
-			wmtrprop.ping_avrg = (float)wmtrnet->GetAvg(nItem);
-			wmtrprop.ping_last = (float)wmtrnet->GetLast(nItem);
-			wmtrprop.ping_best = (float)wmtrnet->GetBest(nItem);
-			wmtrprop.ping_worst = (float)wmtrnet->GetWorst(nItem);
+			wmtrprop.ping_avrg = hop.avg / 1000.0f;
+			wmtrprop.ping_last = hop.last / 1000.0f;
+			wmtrprop.ping_best = hop.best / 1000.0f;
+			wmtrprop.ping_worst = hop.worst / 1000.0f;
 			
-			wmtrprop.pck_loss = wmtrnet->GetPercent(nItem);
-			wmtrprop.pck_recv = wmtrnet->GetReturned(nItem);
-			wmtrprop.pck_sent = wmtrnet->GetXmit(nItem);
+			wmtrprop.pck_loss = hop.percent;
+			wmtrprop.pck_recv = hop.returned;
+			wmtrprop.pck_sent = hop.xmit;
 			
 			wmtrprop.DoModal();
 		}
@@ -578,6 +592,8 @@ void WinMTRDialog::OnRestart()
 	
 	CString sHost;
 	if(state == IDLE) {
+		if(resolving)
+			return;
 		m_comboHost.GetWindowText(sHost);
 		sHost.TrimLeft(); sHost.TrimRight();
 		if(sHost.IsEmpty()) {
@@ -600,21 +616,7 @@ void WinMTRDialog::OnRestart()
 			RegSetValueEx(hKey,"UseIPv6",0,REG_DWORD,(const unsigned char*)&tmp_dword,sizeof(DWORD));
 			RegCloseKey(hKey);
 		}
-		if(InitMTRNet()) {
-			if(m_comboHost.FindString(-1, sHost) == CB_ERR) {
-				m_comboHost.InsertString(m_comboHost.GetCount() - 1,sHost);
-				if(RegCreateKeyEx(HKEY_CURRENT_USER,"Software\\WinMTR\\LRU",0,NULL,0,KEY_ALL_ACCESS,NULL,&hKey,NULL)==ERROR_SUCCESS) {
-					char key_name[20];
-					if(++nrLRU>maxLRU) nrLRU=0;
-					sprintf(key_name, "Host%d", nrLRU);
-					RegSetValueEx(hKey,key_name, 0, REG_SZ, (const unsigned char*)(LPCTSTR)sHost, (DWORD)strlen((LPCTSTR)sHost)+1);
-					tmp_dword = nrLRU;
-					RegSetValueEx(hKey,"NrLRU", 0, REG_DWORD, (const unsigned char*)&tmp_dword, sizeof(DWORD));
-					RegCloseKey(hKey);
-				}
-			}
-			Transit(TRACING);
-		}
+		InitMTRNet();
 	} else {
 		Transit(STOPPING);
 	}
@@ -674,37 +676,16 @@ void WinMTRDialog::OnOptions()
 //*****************************************************************************
 void WinMTRDialog::OnCTTC()
 {
-	char buf[255], t_buf[1000], f_buf[255*100];
+	std::string report;
 	
-	int nh = wmtrnet->GetMax();
-	
-	strcpy(f_buf,  "|------------------------------------------------------------------------------------------|\r\n");
-	sprintf(t_buf, "|                                      WinMTR statistics                                   |\r\n");
-	strcat(f_buf, t_buf);
-	sprintf(t_buf, "|                       Host              -   %%  | Sent | Recv | Best | Avrg | Wrst | Last |\r\n");
-	strcat(f_buf, t_buf);
-	sprintf(t_buf, "|------------------------------------------------|------|------|------|------|------|------|\r\n");
-	strcat(f_buf, t_buf);
-	
-	for(int i=0; i <nh ; i++) {
-		wmtrnet->GetName(i, buf);
-		if(strcmp(buf,"")==0) strcpy(buf,"No response from host");
-		
-		sprintf(t_buf, "|%40s - %4d | %4d | %4d | %4d | %4d | %4d | %4d |\r\n" ,
-				buf, wmtrnet->GetPercent(i),
-				wmtrnet->GetXmit(i), wmtrnet->GetReturned(i), wmtrnet->GetBest(i),
-				wmtrnet->GetAvg(i), wmtrnet->GetWorst(i), wmtrnet->GetLast(i));
-		strcat(f_buf, t_buf);
-	}
-	
-	sprintf(t_buf, "|________________________________________________|______|______|______|______|______|______|\r\n");
-	strcat(f_buf, t_buf);
+	wmtrnet->Snapshot(&path);
+	FormatReport(&path, report);
 	
 	CString cs_tmp((LPCSTR)IDS_STRING_SB_NAME);
-	strcat(f_buf, "   ");
-	strcat(f_buf, (LPCTSTR)cs_tmp);
+	report += "   ";
+	report += (LPCTSTR)cs_tmp;
 	
-	CString source(f_buf);
+	CString source(report.c_str());
 	
 	HGLOBAL clipbuffer;
 	char* buffer;
@@ -731,7 +712,8 @@ void WinMTRDialog::OnCHTC()
 {
 	char buf[255], t_buf[1000], f_buf[255*100];
 	
-	int nh = wmtrnet->GetMax();
+	wmtrnet->Snapshot(&path);
+	int nh = path.count;
 	
 	strcpy(f_buf, "<html><head><title>WinMTR Statistics</title></head><body bgcolor=\"white\">\r\n");
 	sprintf(t_buf, "<center><h2>WinMTR statistics</h2></center>\r\n");
@@ -740,17 +722,26 @@ void WinMTRDialog::OnCHTC()
 	sprintf(t_buf, "<p align=\"center\"> <table border=\"1\" align=\"center\">\r\n");
 	strcat(f_buf, t_buf);
 	
-	sprintf(t_buf, "<tr><td>Host</td> <td>%%</td> <td>Sent</td> <td>Recv</td> <td>Best</td> <td>Avrg</td> <td>Wrst</td> <td>Last</td></tr>\r\n");
+	sprintf(t_buf, "<tr><td>Host</td> <td>%%</td> <td>Sent</td> <td>Recv</td> <td>Best</td> <td>Avrg</td> <td>Wrst</td> <td>Last</td> <td>StDev</td> <td>95%%</td> <td>99%%</td> <td>Jttr</td></tr>\r\n");
 	strcat(f_buf, t_buf);
 	
 	for(int i=0; i <nh ; i++) {
-		wmtrnet->GetName(i, buf);
+		strcpy(buf, path.hop[i].name);
 		if(strcmp(buf,"")==0) strcpy(buf,"No response from host");
 		
-		sprintf(t_buf, "<tr><td>%s</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%4d</td></tr>\r\n" ,
-				buf, wmtrnet->GetPercent(i),
-				wmtrnet->GetXmit(i), wmtrnet->GetReturned(i), wmtrnet->GetBest(i),
-				wmtrnet->GetAvg(i), wmtrnet->GetWorst(i), wmtrnet->GetLast(i));
+		char best[16], avg[16], worst[16], last[16], stdev[16], p95[16], p99[16], jitter[16];
+		FormatRTT(best, sizeof(best), path.hop[i].best);
+		FormatRTT(avg, sizeof(avg), path.hop[i].avg);
+		FormatRTT(worst, sizeof(worst), path.hop[i].worst);
+		FormatRTT(last, sizeof(last), path.hop[i].last);
+		FormatRTT(stdev, sizeof(stdev), path.hop[i].stdev);
+		FormatRTT(p95, sizeof(p95), path.hop[i].p95);
+		FormatRTT(p99, sizeof(p99), path.hop[i].p99);
+		FormatRTT(jitter, sizeof(jitter), path.hop[i].jitter);
+		sprintf(t_buf, "<tr><td>%s</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td></tr>\r\n" ,
+				buf, path.hop[i].percent,
+				path.hop[i].xmit, path.hop[i].returned, best,
+				avg, worst, last, stdev, p95, p99, jitter);
 		strcat(f_buf, t_buf);
 	}
 	
@@ -792,40 +783,18 @@ void WinMTRDialog::OnEXPT()
 					this);
 	if(dlg.DoModal() == IDOK) {
 	
-		char buf[255], t_buf[1000], f_buf[255*100];
-		
-		int nh = wmtrnet->GetMax();
-		
-		strcpy(f_buf,  "|------------------------------------------------------------------------------------------|\r\n");
-		sprintf(t_buf, "|                                      WinMTR statistics                                   |\r\n");
-		strcat(f_buf, t_buf);
-		sprintf(t_buf, "|                       Host              -   %%  | Sent | Recv | Best | Avrg | Wrst | Last |\r\n");
-		strcat(f_buf, t_buf);
-		sprintf(t_buf, "|------------------------------------------------|------|------|------|------|------|------|\r\n");
-		strcat(f_buf, t_buf);
-		
-		for(int i=0; i <nh ; i++) {
-			wmtrnet->GetName(i, buf);
-			if(strcmp(buf,"")==0) strcpy(buf,"No response from host");
-			
-			sprintf(t_buf, "|%40s - %4d | %4d | %4d | %4d | %4d | %4d | %4d |\r\n" ,
-					buf, wmtrnet->GetPercent(i),
-					wmtrnet->GetXmit(i), wmtrnet->GetReturned(i), wmtrnet->GetBest(i),
-					wmtrnet->GetAvg(i), wmtrnet->GetWorst(i), wmtrnet->GetLast(i));
-			strcat(f_buf, t_buf);
-		}
-		
-		sprintf(t_buf, "|________________________________________________|______|______|______|______|______|______|\r\n");
-		strcat(f_buf, t_buf);
+		std::string report;
 		
+		wmtrnet->Snapshot(&path);
+		FormatReport(&path, report);
 		
 		CString cs_tmp((LPCSTR)IDS_STRING_SB_NAME);
-		strcat(f_buf, "   ");
-		strcat(f_buf, (LPCTSTR)cs_tmp);
+		report += "   ";
+		report += (LPCTSTR)cs_tmp;
 		
 		FILE* fp = fopen(dlg.GetPathName(), "wt");
 		if(fp != NULL) {
-			fprintf(fp, "%s", f_buf);
+			fprintf(fp, "%s", report.c_str());
 			fclose(fp);
 		}
 	}
@@ -855,7 +824,8 @@ void WinMTRDialog::OnEXPH()
 		char* t_buf = new char[1000];
 		char* f_buf = new char[255 * 100];
 
-		int nh = wmtrnet->GetMax();
+		wmtrnet->Snapshot(&path);
+		int nh = path.count;
 
 		strcpy(f_buf, "<html><head><title>WinMTR Statistics</title></head><body bgcolor=\"white\">\r\n");
 		sprintf(t_buf, "<center><h2>WinMTR statistics</h2></center>\r\n");
@@ -864,17 +834,26 @@ void WinMTRDialog::OnEXPH()
 		sprintf(t_buf, "<p align=\"center\"> <table border=\"1\" align=\"center\">\r\n");
 		strcat(f_buf, t_buf);
 
-		sprintf(t_buf, "<tr><td>Host</td> <td>%%</td> <td>Sent</td> <td>Recv</td> <td>Best</td> <td>Avrg</td> <td>Wrst</td> <td>Last</td></tr>\r\n");
+		sprintf(t_buf, "<tr><td>Host</td> <td>%%</td> <td>Sent</td> <td>Recv</td> <td>Best</td> <td>Avrg</td> <td>Wrst</td> <td>Last</td> <td>StDev</td> <td>95%%</td> <td>99%%</td> <td>Jttr</td></tr>\r\n");
 		strcat(f_buf, t_buf);
 
 		for(int i=0; i <nh ; i++) {
-			wmtrnet->GetName(i, buf);
+			strcpy(buf, path.hop[i].name);
 			if(strcmp(buf,"")==0) strcpy(buf,"No response from host");
 
-			sprintf(t_buf, "<tr><td>%s</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%4d</td></tr>\r\n" ,
-					buf, wmtrnet->GetPercent(i),
-					wmtrnet->GetXmit(i), wmtrnet->GetReturned(i), wmtrnet->GetBest(i),
-					wmtrnet->GetAvg(i), wmtrnet->GetWorst(i), wmtrnet->GetLast(i));
+			char best[16], avg[16], worst[16], last[16], stdev[16], p95[16], p99[16], jitter[16];
+			FormatRTT(best, sizeof(best), path.hop[i].best);
+			FormatRTT(avg, sizeof(avg), path.hop[i].avg);
+			FormatRTT(worst, sizeof(worst), path.hop[i].worst);
+			FormatRTT(last, sizeof(last), path.hop[i].last);
+			FormatRTT(stdev, sizeof(stdev), path.hop[i].stdev);
+			FormatRTT(p95, sizeof(p95), path.hop[i].p95);
+			FormatRTT(p99, sizeof(p99), path.hop[i].p99);
+			FormatRTT(jitter, sizeof(jitter), path.hop[i].jitter);
+			sprintf(t_buf, "<tr><td>%s</td> <td>%4d</td> <td>%4d</td> <td>%4d</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td> <td>%s</td></tr>\r\n" ,
+					buf, path.hop[i].percent,
+					path.hop[i].xmit, path.hop[i].returned, best,
+					avg, worst, last, stdev, p95, p99, jitter);
 			strcat(f_buf, t_buf);
 		}
 
@@ -1004,23 +983,23 @@ void WinMTRDialog::OnCancel()
 int WinMTRDialog::DisplayRedraw()
 {
 	char buf[255], nr_crt[255];
-	int nh = wmtrnet->GetMax();
+	wmtrnet->Snapshot(&path);
+	int nh = path.count;
 	while(m_listMTR.GetItemCount() > nh) m_listMTR.DeleteItem(m_listMTR.GetItemCount() - 1);
 
 	// Collect RTT data and hostnames for graph
 	int rttData[MAX_GRAPH_HOPS];
-	char* hostnames[MAX_GRAPH_HOPS];
-	char hostnameBuffer[MAX_GRAPH_HOPS][255];
+	const char* hostnames[MAX_GRAPH_HOPS];
 
 	for(int i = 0; i < MAX_GRAPH_HOPS; i++) {
 		rttData[i] = -1;  // Initialize with no data
-		hostnameBuffer[i][0] = '\0';
-		hostnames[i] = hostnameBuffer[i];
+		hostnames[i] = "";
 	}
 
 	for(int i=0; i <nh ; ++i) {
 
-		wmtrnet->GetName(i, buf);
+		const s_hopsnapshot& hop = path.hop[i];
+		strcpy(buf, hop.name);
 		if(!*buf) strcpy(buf,"No response from host");
 
 		sprintf(nr_crt, "%d", i+1);
@@ -1031,43 +1010,64 @@ int WinMTRDialog::DisplayRedraw()
 
 		m_listMTR.SetItem(i, 1, LVIF_TEXT, nr_crt, 0, 0, 0, 0);
 
-		sprintf(buf, "%d", wmtrnet->GetPercent(i));
+		sprintf(buf, "%d", hop.percent);
 		m_listMTR.SetItem(i, 2, LVIF_TEXT, buf, 0, 0, 0, 0);
 
-		sprintf(buf, "%d", wmtrnet->GetXmit(i));
+		sprintf(buf, "%d", hop.xmit);
 		m_listMTR.SetItem(i, 3, LVIF_TEXT, buf, 0, 0, 0, 0);
 
-		sprintf(buf, "%d", wmtrnet->GetReturned(i));
+		sprintf(buf, "%d", hop.returned);
 		m_listMTR.SetItem(i, 4, LVIF_TEXT, buf, 0, 0, 0, 0);
 
-		sprintf(buf, "%d", wmtrnet->GetBest(i));
+		FormatRTT(buf, sizeof(buf), hop.best);
 		m_listMTR.SetItem(i, 5, LVIF_TEXT, buf, 0, 0, 0, 0);
 
-		sprintf(buf, "%d", wmtrnet->GetAvg(i));
+		FormatRTT(buf, sizeof(buf), hop.avg);
 		m_listMTR.SetItem(i, 6, LVIF_TEXT, buf, 0, 0, 0, 0);
 
-		sprintf(buf, "%d", wmtrnet->GetWorst(i));
+		FormatRTT(buf, sizeof(buf), hop.worst);
 		m_listMTR.SetItem(i, 7, LVIF_TEXT, buf, 0, 0, 0, 0);
 
-		int lastRTT = wmtrnet->GetLast(i);
-		sprintf(buf, "%d", lastRTT);
+		int lastRTT = hop.last;
+		FormatRTT(buf, sizeof(buf), lastRTT);
 		m_listMTR.SetItem(i, 8, LVIF_TEXT, buf, 0, 0, 0, 0);
 
+		FormatRTT(buf, sizeof(buf), hop.stdev);
+		m_listMTR.SetItem(i, 9, LVIF_TEXT, buf, 0, 0, 0, 0);
+
+		FormatRTT(buf, sizeof(buf), hop.p95);
+		m_listMTR.SetItem(i, 10, LVIF_TEXT, buf, 0, 0, 0, 0);
+
+		FormatRTT(buf, sizeof(buf), hop.p99);
+		m_listMTR.SetItem(i, 11, LVIF_TEXT, buf, 0, 0, 0, 0);
+
+		FormatRTT(buf, sizeof(buf), hop.jitter);
+		m_listMTR.SetItem(i, 12, LVIF_TEXT, buf, 0, 0, 0, 0);
+
+		// the same over the last SAVED_PINGS probes only
+		sprintf(buf, "%d", hop.recentPercent);
+		m_listMTR.SetItem(i, 13, LVIF_TEXT, buf, 0, 0, 0, 0);
+
+		FormatRTT(buf, sizeof(buf), hop.recentAvg);
+		m_listMTR.SetItem(i, 14, LVIF_TEXT, buf, 0, 0, 0, 0);
+
+		FormatRTT(buf, sizeof(buf), hop.recentJitter);
+		m_listMTR.SetItem(i, 15, LVIF_TEXT, buf, 0, 0, 0, 0);
+
 		// Store RTT and hostname for graph (use Last value for real-time display)
 		if(i < MAX_GRAPH_HOPS) {
 			rttData[i] = lastRTT;
 			// Only pass hostname if packet loss is not 100%
-			int packetLoss = wmtrnet->GetPercent(i);
-			if(packetLoss < 100) {
-				wmtrnet->GetName(i, hostnameBuffer[i]);
+			if(hop.percent < 100) {
+				hostnames[i] = hop.name;
 			}
-			// Otherwise hostnameBuffer[i] stays empty (already initialized above)
+			// Otherwise hostnames[i] stays empty (already initialized above)
 		}
 	}
 
 	// Update the graph with current RTT data and hostnames
 	if(IsWindow(m_graph.m_hWnd) && state == TRACING) {
-		m_graph.AddSample(rttData, (const char* const*)hostnames, nh);
+		m_graph.AddSample(rttData, hostnames, nh);
 	}
 
 	return 0;
@@ -1077,9 +1077,10 @@ int WinMTRDialog::DisplayRedraw()
 //*****************************************************************************
 // WinMTRDialog::InitMTRNet
 //
-//
+// Resolves the host on a worker of WinMTRResolver, the trace starts in
+// StartTrace() once its addresses are known.
 //*****************************************************************************
-int WinMTRDialog::InitMTRNet()
+void WinMTRDialog::InitMTRNet()
 {
 	char hostname[255];
 	char buf[255];
@@ -1088,27 +1089,92 @@ int WinMTRDialog::InitMTRNet()
 	sprintf(buf, "Resolving host %s...", hostname);
 	statusBar.SetPaneText(0,buf);
 	
-	addrinfo nfofilter= {0};
-	addrinfo* anfo;
+	int family = AF_UNSPEC;
 	if(wmtrnet->hasIPv6) {
 		switch(useIPv6) {
 		case 0:
-			nfofilter.ai_family=AF_INET; break;
+			family=AF_INET; break;
 		case 1:
-			nfofilter.ai_family=AF_INET6; break;
-		default:
-			nfofilter.ai_family=AF_UNSPEC;
+			family=AF_INET6; break;
 		}
 	}
-	nfofilter.ai_socktype=SOCK_RAW;
-	nfofilter.ai_flags=AI_NUMERICSERV|AI_ADDRCONFIG;//|AI_V4MAPPED;
-	if(getaddrinfo(hostname,NULL,&nfofilter,&anfo)||!anfo) {
+	m_buttonStart.EnableWindow(FALSE);
+	m_comboHost.EnableWindow(FALSE);
+	m_checkIPv6.EnableWindow(FALSE);
+	m_buttonOptions.EnableWindow(FALSE);
+	resolving = true;
+	std::vector<sockaddr_in6> addrs;
+	if(WinMTRResolver::Shared().ResolveHost(hostname, family, addrs, OnHostAddrs, this))
+		StartTrace(addrs);
+}
+
+// posts the addresses to the UI thread, where the dialog knows if it still wants them
+void WinMTRDialog::OnHostAddrs(void* owner, const std::vector<sockaddr_in6>& addrs)
+{
+	WinMTRDialog* wmtrdlg = (WinMTRDialog*)owner;
+	std::vector<sockaddr_in6>* copy = new std::vector<sockaddr_in6>(addrs);
+	if(!::PostMessage(wmtrdlg->GetSafeHwnd(), WM_WINMTR_RESOLVED, 0, (LPARAM)copy))
+		delete copy;
+}
+
+LRESULT WinMTRDialog::OnHostResolved(WPARAM wParam, LPARAM lParam)
+{
+	std::vector<sockaddr_in6>* addrs = (std::vector<sockaddr_in6>*)lParam;
+	if(resolving && state == IDLE)
+		StartTrace(*addrs);
+	delete addrs;
+	return 0;
+}
+
+//*****************************************************************************
+// WinMTRDialog::StartTrace
+//
+// Traces the first address, getaddrinfo() already sorted them by preference.
+// The others are only listed in the status bar.
+//*****************************************************************************
+void WinMTRDialog::StartTrace(const std::vector<sockaddr_in6>& addrs)
+{
+	resolving = false;
+	if(addrs.empty()) {
 		statusBar.SetPaneText(0, CString((LPCSTR)IDS_STRING_SB_NAME));
+		m_buttonStart.EnableWindow(TRUE);
+		m_comboHost.EnableWindow(TRUE);
+		m_checkIPv6.EnableWindow(wmtrnet->hasIPv6);
+		m_buttonOptions.EnableWindow(TRUE);
 		AfxMessageBox("Unable to resolve hostname.");
-		return 0;
+		return;
+	}
+	target = addrs[0];
+	targetAddrs.Empty();
+	for(size_t i=0; i<addrs.size(); ++i) {
+		char buf[NI_MAXHOST];
+		socklen_t addrlen = addrs[i].sin6_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+		if(getnameinfo((const sockaddr*)&addrs[i], addrlen, buf, NI_MAXHOST, NULL, 0, NI_NUMERICHOST))
+			continue;
+		if(!targetAddrs.IsEmpty())
+			targetAddrs += i == 1 ? " (also " : ", ";
+		targetAddrs += buf;
 	}
-	freeaddrinfo(anfo);
-	return 1;
+	if(addrs.size() > 1)
+		targetAddrs += ")";
+	
+	CString sHost;
+	HKEY hKey; DWORD tmp_dword;
+	m_comboHost.GetWindowText(sHost);
+	sHost.TrimLeft(); sHost.TrimRight();
+	if(m_comboHost.FindString(-1, sHost) == CB_ERR) {
+		m_comboHost.InsertString(m_comboHost.GetCount() - 1,sHost);
+		if(RegCreateKeyEx(HKEY_CURRENT_USER,"Software\\WinMTR\\LRU",0,NULL,0,KEY_ALL_ACCESS,NULL,&hKey,NULL)==ERROR_SUCCESS) {
+			char key_name[20];
+			if(++nrLRU>maxLRU) nrLRU=0;
+			sprintf(key_name, "Host%d", nrLRU);
+			RegSetValueEx(hKey,key_name, 0, REG_SZ, (const unsigned char*)(LPCTSTR)sHost, (DWORD)strlen((LPCTSTR)sHost)+1);
+			tmp_dword = nrLRU;
+			RegSetValueEx(hKey,"NrLRU", 0, REG_DWORD, (const unsigned char*)&tmp_dword, sizeof(DWORD));
+			RegCloseKey(hKey);
+		}
+	}
+	Transit(TRACING);
 }
 
 
@@ -1121,31 +1187,7 @@ void PingThread(void* p)
 {
 	WinMTRDialog* wmtrdlg = (WinMTRDialog*)p;
 	WaitForSingleObject(wmtrdlg->traceThreadMutex, INFINITE);
-	
-	char hostname[255];
-	wmtrdlg->m_comboHost.GetWindowText(hostname, 255);
-	
-	addrinfo nfofilter= {0};
-	addrinfo* anfo;
-	if(wmtrdlg->wmtrnet->hasIPv6) {
-		switch(wmtrdlg->useIPv6) {
-		case 0:
-			nfofilter.ai_family=AF_INET; break;
-		case 1:
-			nfofilter.ai_family=AF_INET6; break;
-		default:
-			nfofilter.ai_family=AF_UNSPEC;
-		}
-	}
-	nfofilter.ai_socktype=SOCK_RAW;
-	nfofilter.ai_flags=AI_NUMERICSERV|AI_ADDRCONFIG;//|AI_V4MAPPED;
-	if(getaddrinfo(hostname,NULL,&nfofilter,&anfo)||!anfo) { //we use first address returned
-		AfxMessageBox("Unable to resolve hostname. (again)");
-		ReleaseMutex(wmtrdlg->traceThreadMutex);
-		return;
-	}
-	wmtrdlg->wmtrnet->DoTrace(anfo->ai_addr);
-	freeaddrinfo(anfo);
+	wmtrdlg->wmtrnet->DoTrace((sockaddr*)&wmtrdlg->target);
 	ReleaseMutex(wmtrdlg->traceThreadMutex);
 }
 
@@ -1270,7 +1312,10 @@ void WinMTRDialog::Transit(STATES new_state)
 		m_comboHost.EnableWindow(FALSE);
 		m_checkIPv6.EnableWindow(FALSE);
 		m_buttonOptions.EnableWindow(FALSE);
-		statusBar.SetPaneText(0, "Double click on host name for more information.");
+		statusBar.SetPaneText(0, "Tracing " + targetAddrs + ". Double click on host name for more information.");
+		wmtrnet->pingsize = pingsize;
+		wmtrnet->interval = interval;
+		wmtrnet->useDNS = useDNS;
 		_beginthread(PingThread, 0 , this);
 		m_buttonStart.EnableWindow(TRUE);
 		break;
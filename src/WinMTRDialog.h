@@ -14,11 +14,13 @@
 #define WINMTRDIALOG_H_
 
 #define WINMTR_DIALOG_TIMER 100
+#define WM_WINMTR_RESOLVED (WM_APP + 1)	// lParam: new std::vector<sockaddr_in6> of the target
 
 #include "WinMTRStatusBar.h"
 #include "WinMTRNet.h"
 #include "WinMTRGraph.h"
 #include "afxlinkctrl.h"
+#include <vector>
 
 //*****************************************************************************
 // CLASS:  WinMTRDialog
@@ -78,7 +80,8 @@ public:
 
 	WinMTRGraph m_graph;  // Real-time RTT graph
 
-	int InitMTRNet();
+	void InitMTRNet();
+	void StartTrace(const std::vector<sockaddr_in6>& addrs);
 	
 	int DisplayRedraw();
 	void Transit(STATES new_state);
@@ -98,6 +101,10 @@ public:
 	unsigned char		useIPv6;
 	bool				hasUseIPv6FromCmdLine;
 	WinMTRNet*			wmtrnet;
+	s_pathsnapshot		path;		// last WinMTRNet::Snapshot(), shared by the list, graph and exports
+	bool				resolving;	// waiting for WM_WINMTR_RESOLVED
+	sockaddr_in6		target;		// address PingThread traces
+	CString				targetAddrs;	// every address of the target, for the status bar
 	
 	void SetHostName(const char* host);
 	void SetInterval(float i);
@@ -132,6 +139,8 @@ protected:
 
 	afx_msg void OnDblclkList(NMHDR* pNMHDR, LRESULT* pResult);
 	afx_msg void OnClickList(NMHDR* pNMHDR, LRESULT* pResult);
+	afx_msg LRESULT OnHostResolved(WPARAM wParam, LPARAM lParam);
+	static void OnHostAddrs(void* owner, const std::vector<sockaddr_in6>& addrs);
 
 	DECLARE_MESSAGE_MAP()
 public:
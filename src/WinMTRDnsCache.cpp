@@ -0,0 +1,188 @@
+//*****************************************************************************
+// FILE:            WinMTRDnsCache.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRDnsCache.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+size_t s_dnskeyhash::operator()(const s_dnskey& key) const
+{
+	// FNV-1a over the address bytes
+	DWORD hash = 2166136261u;
+	const unsigned char* p = (const unsigned char*)&key.addr;
+	for(size_t i=0; i<sizeof(key.addr); ++i)
+		hash = (hash ^ p[i]) * 16777619u;
+	return hash ^ key.family;
+}
+
+WinMTRDnsCache::WinMTRDnsCache()
+	: records(NULL), view(NULL), viewSize(0)
+{
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+#else
+	file = -1;
+#endif
+}
+
+WinMTRDnsCache::~WinMTRDnsCache()
+{
+	Close();
+}
+
+//*****************************************************************************
+// WinMTRDnsCache::Open
+//
+// A file of another size or layout is started over.
+//*****************************************************************************
+bool WinMTRDnsCache::Open(const char* filename)
+{
+	Close();
+	viewSize = sizeof(s_dnsheader) + sizeof(s_dnsrecord) * DNSCACHE_RECORDS;
+#ifdef _WIN32
+	file = CreateFile(filename, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	bool fresh = !GetFileSizeEx(file, &size) || size.QuadPart != (LONGLONG)viewSize;
+	mapping = CreateFileMapping(file, NULL, PAGE_READWRITE, 0, (DWORD)viewSize, NULL);
+	if(mapping)
+		view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, viewSize);
+#else
+	file = open(filename, O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+	if(file < 0)
+		return false;
+	struct stat st;
+	bool fresh = fstat(file, &st) || st.st_size != (off_t)viewSize;
+	if(!fresh || !ftruncate(file, viewSize)) {
+		view = mmap(NULL, viewSize, PROT_READ|PROT_WRITE, MAP_SHARED, file, 0);
+		if(view == MAP_FAILED) view = NULL;
+	}
+#endif
+	if(!view) {
+		Close();
+		return false;
+	}
+	s_dnsheader* header = (s_dnsheader*)view;
+	if(fresh || header->magic != DNSCACHE_MAGIC || header->records != DNSCACHE_RECORDS || header->recordSize != sizeof(s_dnsrecord)) {
+		memset(view, 0, viewSize);
+		header->magic = DNSCACHE_MAGIC;
+		header->records = DNSCACHE_RECORDS;
+		header->recordSize = sizeof(s_dnsrecord);
+	}
+	records = (s_dnsrecord*)(header + 1);
+	return true;
+}
+
+void WinMTRDnsCache::Close()
+{
+#ifdef _WIN32
+	if(view) UnmapViewOfFile(view);
+	if(mapping) CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+#else
+	if(view) munmap(view, viewSize);
+	if(file >= 0) close(file);
+	file = -1;
+#endif
+	view = NULL;
+	records = NULL;
+}
+
+bool WinMTRDnsCache::DefaultPath(char* filename, size_t size)
+{
+#ifdef _WIN32
+	const char* dir = getenv("LOCALAPPDATA");
+	if(!dir) return false;
+	return snprintf(filename, size, "%s\\WinMTR-dns.cache", dir) < (int)size;
+#else
+	const char* dir = getenv("XDG_CACHE_HOME");
+	if(dir && *dir)
+		return snprintf(filename, size, "%s/winmtr-dns.cache", dir) < (int)size;
+	dir = getenv("HOME");
+	if(!dir) return false;
+	return snprintf(filename, size, "%s/.cache/winmtr-dns.cache", dir) < (int)size;
+#endif
+}
+
+//*****************************************************************************
+// WinMTRDnsCache::Lookup
+//
+//
+//*****************************************************************************
+ULONGLONG WinMTRDnsCache::Lookup(const s_dnskey& key, char* name)
+{
+	if(!records)
+		return 0;
+	ULONGLONG now = (ULONGLONG)time(NULL);
+	size_t first = s_dnskeyhash()(key);
+	for(int i=0; i<DNSCACHE_PROBE; ++i) {
+		s_dnsrecord record = records[(first + i) & (DNSCACHE_RECORDS - 1)];
+		if(record.family != key.family || memcmp(&record.addr, &key.addr, sizeof(key.addr)))
+			continue;
+		if(record.check != Check(record) || record.expires <= now)
+			return 0;
+		record.name[DNSCACHE_NAME - 1] = '\0';
+		strcpy(name, record.name);
+		return record.expires - now;
+	}
+	return 0;
+}
+
+//*****************************************************************************
+// WinMTRDnsCache::Store
+//
+// Goes into the record of the same address, a free or expired one, or the
+// one of the probe sequence that expires first, in that order.
+//*****************************************************************************
+void WinMTRDnsCache::Store(const s_dnskey& key, const char* name, ULONGLONG seconds)
+{
+	if(!records || strlen(name) >= DNSCACHE_NAME)
+		return;
+	ULONGLONG now = (ULONGLONG)time(NULL);
+	size_t first = s_dnskeyhash()(key);
+	s_dnsrecord* target = NULL;
+	ULONGLONG targetRank = 0;
+	for(int i=0; i<DNSCACHE_PROBE; ++i) {
+		s_dnsrecord* record = &records[(first + i) & (DNSCACHE_RECORDS - 1)];
+		if(record->family == key.family && !memcmp(&record->addr, &key.addr, sizeof(key.addr))) {
+			target = record;
+			break;
+		}
+		ULONGLONG rank = record->family && record->expires > now ? record->expires : 0;
+		if(!target || rank < targetRank) {
+			target = record;
+			targetRank = rank;
+		}
+	}
+	s_dnsrecord record;
+	memset(&record, 0, sizeof(record));
+	record.family = key.family;
+	record.addr = key.addr;
+	record.expires = now + seconds;
+	strcpy(record.name, name);
+	record.check = Check(record);
+	*target = record;
+}
+
+// FNV-1a over the record after the check
+DWORD WinMTRDnsCache::Check(const s_dnsrecord& record)
+{
+	DWORD hash = 2166136261u;
+	const unsigned char* p = (const unsigned char*)&record.family;
+	const unsigned char* end = (const unsigned char*)(&record + 1);
+	for(; p<end; ++p)
+		hash = (hash ^ *p) * 16777619u;
+	return hash;
+}
@@ -0,0 +1,92 @@
+//*****************************************************************************
+// FILE:            WinMTRDnsCache.h
+//
+//
+// DESCRIPTION:
+//   Reverse DNS results kept in a memory-mapped file between sessions, so the
+//   names of known hops are there on the first refresh. Every result is
+//   written to the mapping as it arrives.
+//
+// NOTES:
+//   The file is a hash table of DNSCACHE_RECORDS fixed-size records, an
+//   address can be in one of the DNSCACHE_PROBE records after its hash. When
+//   they are all taken the one that expires first is replaced. Names longer
+//   than DNSCACHE_NAME - 1 are only kept in memory.
+//
+//*****************************************************************************
+
+#ifndef WINMTRDNSCACHE_H_
+#define WINMTRDNSCACHE_H_
+
+#define DNSCACHE_RECORDS	8192	// power of two
+#define DNSCACHE_PROBE		8
+#define DNSCACHE_NAME		96
+#define DNSCACHE_MAGIC		0x31534E44	// "DNS1"
+
+// address of a lookup, the key of both caches
+struct s_dnskey {
+	int			family;
+	in6_addr	addr;		// IPv4 in the first four bytes
+
+	bool operator==(const s_dnskey& other) const {
+		return family == other.family && !memcmp(&addr, &other.addr, sizeof(addr));
+	}
+};
+
+struct s_dnskeyhash {
+	size_t operator()(const s_dnskey& key) const;
+};
+
+// one result as stored in the file
+struct s_dnsrecord {
+	DWORD		check;		// hash of the rest, a torn write of another instance doesn't match
+	int			family;		// 0 = free
+	in6_addr	addr;
+	ULONGLONG	expires;	// seconds since 1970, the file outlives the tick count
+	char		name[DNSCACHE_NAME];	// "" if the address has no name
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRDnsCache
+//
+// Not thread safe, WinMTRResolver calls it under its lock.
+//*****************************************************************************
+
+class WinMTRDnsCache
+{
+public:
+	WinMTRDnsCache();
+	~WinMTRDnsCache();
+
+	// maps the file, creating it if needed; without it nothing is kept
+	bool	Open(const char* filename);
+	void	Close();
+	// the file of the current user
+	static bool	DefaultPath(char* filename, size_t size);
+
+	// returns the seconds left of an entry for key with its name, 0 if none
+	ULONGLONG	Lookup(const s_dnskey& key, char* name);
+	void		Store(const s_dnskey& key, const char* name, ULONGLONG seconds);
+
+private:
+	struct s_dnsheader {
+		DWORD	magic;
+		DWORD	records;
+		DWORD	recordSize;
+		DWORD	reserved;
+	};
+
+	static DWORD	Check(const s_dnsrecord& record);
+
+	s_dnsrecord*	records;
+	void*			view;
+	size_t			viewSize;
+#ifdef _WIN32
+	HANDLE			file;
+	HANDLE			mapping;
+#else
+	int				file;
+#endif
+};
+
+#endif	// ifndef WINMTRDNSCACHE_H_
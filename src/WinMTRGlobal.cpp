@@ -25,3 +25,42 @@ int gettimeofday(struct timeval* tv, struct timezone* / *tz* /)
    return 0;
 }// */
 
+
+//*****************************************************************************
+// GetTimeMicros
+//
+// microseconds of the monotonic high resolution clock, the time base of the
+// probe schedules
+//*****************************************************************************
+ULONGLONG GetTimeMicros()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = {0};
+	LARGE_INTEGER counter;
+	if(!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	// split, counter * 1000000 would overflow after a few weeks
+	ULONGLONG seconds = counter.QuadPart / frequency.QuadPart;
+	ULONGLONG rest = counter.QuadPart % frequency.QuadPart;
+	return seconds * 1000000 + rest * 1000000 / frequency.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ULONGLONG)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+#ifndef _WIN32
+//*****************************************************************************
+// GetTickCount64
+//
+// milliseconds of the monotonic clock, like the win32 function
+//*****************************************************************************
+ULONGLONG GetTickCount64()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ULONGLONG)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+#endif
@@ -13,6 +13,8 @@
 #ifndef GLOBAL_H_
 #define GLOBAL_H_
 
+#ifdef _WIN32
+
 #ifndef  _WIN64
 #define  _USE_32BIT_TIME_T
 #endif
@@ -46,18 +48,77 @@
 #include <sys/timeb.h>
 #include <sys/stat.h>
 
+#else // POSIX, only the measurement core and the headless modes build here (CMakeLists.txt)
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+typedef uint32_t			DWORD;
+typedef uint16_t			WORD;
+typedef uint8_t				UCHAR;
+typedef int					BOOL;
+typedef unsigned long long	ULONGLONG;
+#define TRUE	1
+#define FALSE	0
+
+// status codes of the Windows ICMP API (ipexport.h), used by the probe backends on every platform
+#define IP_STATUS_BASE				11000
+#define IP_SUCCESS					0
+#define IP_BUF_TOO_SMALL			(IP_STATUS_BASE + 1)
+#define IP_DEST_NET_UNREACHABLE		(IP_STATUS_BASE + 2)
+#define IP_DEST_HOST_UNREACHABLE	(IP_STATUS_BASE + 3)
+#define IP_DEST_PROT_UNREACHABLE	(IP_STATUS_BASE + 4)
+#define IP_DEST_PORT_UNREACHABLE	(IP_STATUS_BASE + 5)
+#define IP_NO_RESOURCES				(IP_STATUS_BASE + 6)
+#define IP_BAD_OPTION				(IP_STATUS_BASE + 7)
+#define IP_HW_ERROR					(IP_STATUS_BASE + 8)
+#define IP_PACKET_TOO_BIG			(IP_STATUS_BASE + 9)
+#define IP_REQ_TIMED_OUT			(IP_STATUS_BASE + 10)
+#define IP_BAD_REQ					(IP_STATUS_BASE + 11)
+#define IP_BAD_ROUTE				(IP_STATUS_BASE + 12)
+#define IP_TTL_EXPIRED_TRANSIT		(IP_STATUS_BASE + 13)
+#define IP_TTL_EXPIRED_REASSEM		(IP_STATUS_BASE + 14)
+#define IP_PARAM_PROBLEM			(IP_STATUS_BASE + 15)
+#define IP_SOURCE_QUENCH			(IP_STATUS_BASE + 16)
+#define IP_OPTION_TOO_BIG			(IP_STATUS_BASE + 17)
+#define IP_BAD_DESTINATION			(IP_STATUS_BASE + 18)
+#define IP_GENERAL_FAILURE			(IP_STATUS_BASE + 50)
+
+ULONGLONG GetTickCount64();
+
+#endif // _WIN32
+
 #include "resource.h"
 
+ULONGLONG GetTimeMicros();
+
 #define WINMTR_VERSION	"1.0"
 #define WINMTR_LICENSE	"GPLv2 - GNU General Public License, version 2"
 #define WINMTR_HOMEPAGE	"https://github.com/White-Tiger/WinMTR"
 
 #define DEFAULT_PING_SIZE	64
 #define DEFAULT_INTERVAL	1.0
+#define MIN_INTERVAL		0.01	// seconds, shorter intervals are raised to it
 #define DEFAULT_MAX_LRU		128
 #define DEFAULT_DNS			TRUE
+#define DEFAULT_REPORT_COUNT	10
+#define DEFAULT_DAEMON_PERIOD	60		// seconds between the tables of --daemon
+#define PARIS_FLOW			0		// flow of the probes of --paris, see WinMTRProbe::SetFlow()
+#define DEFAULT_MDA_CONFIDENCE	95		// percent, of --multipath
 
-#define SAVED_PINGS 100
+#define SAVED_PINGS 100		// probes per hop behind the recent loss, average and jitter
 #define MaxHost 256
 //#define MaxSequence 65536
 #define MaxSequence 32767
@@ -84,7 +145,7 @@
 #define IP_HEADER_LENGTH   20
 
 
-#define MTR_NR_COLS 9
+#define MTR_NR_COLS 16
 
 const char MTR_COLS[ MTR_NR_COLS ][10] = {
 	"Hostname",
@@ -95,13 +156,22 @@ const char MTR_COLS[ MTR_NR_COLS ][10] = {
 	"Best",
 	"Avrg",
 	"Worst",
-	"Last"
+	"Last",
+	"StDev",
+	"95%",
+	"99%",
+	"Jitter",
+	"Rcnt Loss",
+	"Rcnt Avrg",
+	"Rcnt Jttr"
 };
 
 const int MTR_COL_LENGTH[ MTR_NR_COLS ] = {
-	249, 30, 50, 40, 40, 50, 50, 50, 50
+	249, 30, 50, 40, 40, 50, 50, 50, 50, 50, 50, 50, 50, 60, 60, 60
 };
 
+#ifdef _WIN32
 int gettimeofday(struct timeval* tv, struct timezone* tz);
+#endif
 
 #endif // ifndef GLOBAL_H_
@@ -9,26 +9,19 @@
 #ifndef WINMTRGRAPH_H_
 #define WINMTRGRAPH_H_
 
-#include <vector>
-#include <deque>
 #include <gdiplus.h>
+#include "WinMTRPlot.h"
 
 #pragma comment(lib, "gdiplus.lib")
+#pragma comment(lib, "msimg32.lib")     // TransparentBlt
 
-#define MAX_GRAPH_SAMPLES 300  // 5 minutes at 1 sample/second
-#define MAX_GRAPH_HOPS 30
-
-struct RTTSample {
-    DWORD timestamp;  // GetTickCount() value
-    int rtt[MAX_GRAPH_HOPS];  // RTT for each hop (-1 = no data)
-    char hostnames[MAX_GRAPH_HOPS][255];  // Hostname for each hop
-    int validHops;
-};
+#define LAYER_KEY RGB(32, 32, 32)   // background of the data layer, transparent when composed
 
 //*****************************************************************************
 // CLASS:  WinMTRGraph
 //
-// Modern graph control that displays RTT over time with colored lines
+// Modern graph control that displays RTT over time with colored lines. The
+// graph itself is a WinMTRPlot drawn through GDI+.
 //*****************************************************************************
 class WinMTRGraph : public CWnd
 {
@@ -38,33 +31,30 @@ public:
 
     BOOL Create(DWORD dwStyle, const RECT& rect, CWnd* pParentWnd, UINT nID);
 
-    // Add a new RTT sample for all hops with hostnames
+    // Add a new RTT sample in us for all hops with hostnames
     void AddSample(const int* rttValues, const char* const* hostnames, int numHops);
 
     // Clear all graph data
     void ClearData();
 
     // Set auto-scale mode
-    void SetAutoScale(BOOL autoScale) { m_autoScale = autoScale; }
+    void SetAutoScale(BOOL autoScale) { m_plot.SetAutoScale(autoScale != FALSE); }
 
     // Set max RTT for manual scale
-    void SetMaxRTT(int maxRTT) { m_maxRTT = maxRTT; }
+    void SetMaxRTT(int maxRTT) { m_plot.SetMaxRTT(maxRTT); }
 
     // Set selected hop (or -1 for all hops)
-    void SetSelectedHop(int hopIndex) { m_selectedHop = hopIndex; Invalidate(); }
+    void SetSelectedHop(int hopIndex) { m_plot.SetSelectedHop(hopIndex); Invalidate(); }
 
     // Copy graph to clipboard as bitmap
     BOOL CopyToClipboard();
 
-    // Export graph to file
+    // Export graph to a PNG file, rendered without GDI+
     BOOL ExportToFile(const CString& filePath);
 
     // Set time resolution (number of samples to display)
     void SetTimeResolution(int maxSamples) {
-        if (maxSamples > 0 && maxSamples <= 86400) {  // Max 24 hours at 1/sec
-            m_maxSamples = maxSamples;
-            Invalidate();
-        }
+        if (m_plot.SetTimeResolution(maxSamples)) Invalidate();
     }
 
 protected:
@@ -75,25 +65,27 @@ protected:
     DECLARE_MESSAGE_MAP()
 
 private:
-    void DrawGraph(Gdiplus::Graphics& graphics, const CRect& clientRect);
-    void DrawGrid(Gdiplus::Graphics& graphics, const CRect& graphRect);
-    void DrawData(Gdiplus::Graphics& graphics, const CRect& graphRect);
-    void DrawLegend(Gdiplus::Graphics& graphics, const CRect& clientRect);
-
-    Gdiplus::Color GetHopColor(int hopIndex);
-    Gdiplus::Color GetHopColorByPosition(int hopPosition, int totalVisibleHops);
-    int GetColorIndexForHop(int hopPosition, int totalVisibleHops);
-
-    std::deque<RTTSample> m_samples;
-    BOOL m_autoScale;
-    int m_maxRTT;
+    void CreateLayers(CDC* pDC, CSize size);
+    static void CreateLayer(CDC* pDC, CSize size, CDC& layerDC, CBitmap& layerBitmap);
+    void UpdateDataLayer();
+
+    WinMTRPlot m_plot;
     ULONG_PTR m_gdiplusToken;
-    int m_selectedHop;  // -1 = show all, >= 0 = show only selected hop
-    int m_maxSamples;   // Maximum samples to display (time resolution)
-    int m_currentVisibleHops;  // Number of currently visible hops (for color spacing)
 
-    // Colors for different hops (up to 30)
-    static const Gdiplus::Color HopColors[MAX_GRAPH_HOPS];
+    // Cached layers of OnPaint, the bitmaps before the DCs so the DCs go first
+    CBitmap m_staticBitmap;
+    CBitmap m_dataBitmap;
+    CBitmap m_frameBitmap;
+    CDC m_staticDC;             // background, grid, labels and legend
+    CDC m_dataDC;               // lines on LAYER_KEY
+    CDC m_frameDC;              // both composed, copied to the screen
+    CSize m_layerSize;
+    bool m_staticValid;
+    DWORD m_staticKey;          // hash of what the static layer shows
+    bool m_dataValid;
+    DWORD m_dataKey;            // hash of the scale, colors and area of the lines
+    double m_dataOrigin;        // plot origin the data layer was drawn at
+    ULONGLONG m_dataLast;       // newest sample serial or bucket drawn
 };
 
 #endif // WINMTRGRAPH_H_
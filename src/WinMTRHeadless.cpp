@@ -0,0 +1,337 @@
+//*****************************************************************************
+// FILE:            WinMTRHeadless.cpp
+//
+//
+// DESCRIPTION:
+//   --report and --daemon. They only use the measurement core, so besides
+//   WinMTRMain they run from the console build on Linux.
+//
+// NOTES:
+//   Options come from the command line only, the registry isn't read.
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRHeadless.h"
+#include "WinMTRReport.h"
+#include "WinMTRMonitor.h"
+#include "WinMTRPlot.h"
+#include "WinMTRRaster.h"
+
+#define PNG_WIDTH	800		// size of the graph of --png
+#define PNG_HEIGHT	400
+
+//*****************************************************************************
+// WriteTo
+//
+// On Windows the GUI subsystem has no standard handles unless redirected,
+// the text goes to the console of the parent process then.
+//*****************************************************************************
+#ifdef _WIN32
+static void WriteTo(HANDLE& out, DWORD which, const std::string& text)
+{
+	if(out == NULL || out == INVALID_HANDLE_VALUE) {
+		out = GetStdHandle(which);
+		if((out == NULL || out == INVALID_HANDLE_VALUE) && AttachConsole(ATTACH_PARENT_PROCESS))
+			out = CreateFile("CONOUT$", GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+	}
+	if(out != NULL && out != INVALID_HANDLE_VALUE) {
+		DWORD written;
+		WriteFile(out, text.c_str(), (DWORD)text.length(), &written, NULL);
+	}
+}
+
+void WriteOutput(const std::string& text)
+{
+	static HANDLE out = NULL;
+	WriteTo(out, STD_OUTPUT_HANDLE, text);
+}
+
+void WriteError(const std::string& text)
+{
+	static HANDLE out = NULL;
+	WriteTo(out, STD_ERROR_HANDLE, text);
+}
+#else
+static void WriteTo(FILE* out, const std::string& text)
+{
+	fwrite(text.c_str(), 1, text.length(), out);
+	fflush(out);
+}
+
+void WriteOutput(const std::string& text)
+{
+	WriteTo(stdout, text);
+}
+
+void WriteError(const std::string& text)
+{
+	WriteTo(stderr, text);
+}
+#endif
+
+// the port of --tcp, TCP_DEFAULT_PORT if it isn't one
+static WORD TcpPort(const char* value)
+{
+	int port = atoi(value);
+	return port > 0 && port < 65536 ? (WORD)port : TCP_DEFAULT_PORT;
+}
+
+// the confidence of --multipath in percent as a fraction, DEFAULT_MDA_CONFIDENCE if it isn't one
+static double Confidence(const char* value)
+{
+	double percent = atof(value);
+	return (percent > 0 && percent < 100 ? percent : DEFAULT_MDA_CONFIDENCE) / 100;
+}
+
+//*****************************************************************************
+// WritePlot
+//
+// The graph of --png over the whole report, drawn with the software
+// rasterizer like the dialog exports it.
+//*****************************************************************************
+static bool WritePlot(WinMTRPlot& plot, const char* filename)
+{
+	int span = plot.Size() < MAX_HISTORY_SAMPLES ? plot.Size() : MAX_HISTORY_SAMPLES;
+	plot.SetTimeResolution(span > 1 ? span : 1);
+	WinMTRRaster raster(PNG_WIDTH, PNG_HEIGHT);
+	plot.Draw(raster, PNG_WIDTH, PNG_HEIGHT);
+
+	FILE* file = fopen(filename, "wb");
+	if(file == NULL)
+		return false;
+	bool written = raster.WritePNG(file);
+	if(fclose(file) != 0)
+		written = false;
+	return written;
+}
+
+//*****************************************************************************
+// DaemonReport
+//
+// onReport of the --daemon monitor, the table of every target.
+//*****************************************************************************
+static void DaemonReport(WinMTRMonitor* monitor, void* /*param*/)
+{
+	std::string report, table;
+	s_pathsnapshot path;
+	char t_buf[1000];
+	time_t now = time(NULL);
+	char stamp[64];
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+	for(int i=0; i<monitor->GetTargetCount(); ++i) {
+		snprintf(t_buf, sizeof(t_buf), "%s  %s\r\n", stamp, monitor->GetTargetName(i));
+		report += t_buf;
+		monitor->Snapshot(i, &path);
+		FormatReport(&path, table);
+		report += table;
+	}
+	WriteOutput(report);
+}
+
+//*****************************************************************************
+// ReportMain
+//
+// --report: trace without the dialog and print the statistics table, then
+// exit. --png FILE saves the graph of the trace too.
+//*****************************************************************************
+int ReportMain(const char* cmd)
+{
+	char value[1024];
+	char png[1024];
+	std::string host_name = "";
+	int family = AF_UNSPEC;
+
+	// not deleted, resolver threads may use it until the process exits
+	WinMTRNet* wmtrnet = new WinMTRNet();
+	wmtrnet->count = DEFAULT_REPORT_COUNT;
+
+	if(GetParamValue(cmd, "count",'c', value) && atoi(value) > 0)
+		wmtrnet->count = atoi(value);
+	if(GetParamValue(cmd, "interval",'i', value))
+		wmtrnet->interval = atof(value);
+	if(GetParamValue(cmd, "size",'s', value))
+		wmtrnet->pingsize = (WORD)atoi(value);
+	if(GetParamValue(cmd, "numeric",'n', NULL))
+		wmtrnet->useDNS = FALSE;
+	if(GetParamValue(cmd, "ipv6",'6', NULL))
+		family = AF_INET6;
+	if(GetParamValue(cmd, "ipv4",'4', NULL))
+		family = AF_INET;
+	WinMTRPlot* plot = NULL;
+	if(GetParamValue(cmd, "png",'g', png))
+		plot = new WinMTRPlot();
+
+	std::string report;
+	bool ok = false;
+	if(GetParamValue(cmd, "udp",'u', NULL) && !wmtrnet->SetProbeType(PROBE_UDP))
+		report = "Unable to initialize the UDP backend: " + wmtrnet->error + "\r\n";
+	else if(GetParamValue(cmd, "tcp",'t', value) && !wmtrnet->SetProbeType(PROBE_TCP, TcpPort(value)))
+		report = "Unable to initialize the TCP backend: " + wmtrnet->error + "\r\n";
+	else if(GetParamValue(cmd, "paris",'P', NULL) && !wmtrnet->SetFlow(PARIS_FLOW))
+		report = "Unable to keep the probes in one flow with this backend.\r\n";
+	else if(GetParamValue(cmd, "multipath",'M', value) && !wmtrnet->SetMultipath(Confidence(value)))
+		report = "Unable to vary the flow of the probes with this backend.\r\n";
+	else if(GetHostNameParamValue(cmd, host_name)) {
+		if(GetParamValue(cmd, "multipath",'M', NULL) && wmtrnet->interval < MDA_MIN_INTERVAL) {
+			snprintf(value, sizeof(value), "Interval raised to %g s, the shortest of --multipath.\r\n", MDA_MIN_INTERVAL);
+			WriteError(value);
+		}
+		ok = RunReport(wmtrnet, host_name.c_str(), family, report, plot);
+	} else
+		report = "Usage: WinMTR --report [--count N] [options] target_host_name\r\n";
+
+	if(ok)
+		WriteOutput(report);
+	else
+		WriteError(report);
+	if(ok && plot && !WritePlot(*plot, png)) {
+		WriteError("Unable to write " + std::string(png) + "\r\n");
+		ok = false;
+	}
+	delete plot;
+	return ok ? 0 : 1;
+}
+
+//*****************************************************************************
+// DaemonMain
+//
+// --daemon FILE: trace every host listed in FILE on one probe loop and print
+// the tables of all of them every --period seconds, until killed.
+//*****************************************************************************
+int DaemonMain(const char* cmd)
+{
+	char value[1024];
+	char filename[1024];
+	int family = AF_UNSPEC;
+
+	WinMTRMonitor* monitor = new WinMTRMonitor();
+	monitor->reportPeriod = DEFAULT_DAEMON_PERIOD * 1000;
+	monitor->onReport = DaemonReport;
+
+	GetParamValue(cmd, "daemon",'d', filename);
+	if(GetParamValue(cmd, "period",'p', value) && atoi(value) > 0)
+		monitor->reportPeriod = atoi(value) * 1000;
+	if(GetParamValue(cmd, "interval",'i', value))
+		monitor->interval = atof(value);
+	if(GetParamValue(cmd, "size",'s', value))
+		monitor->pingsize = (WORD)atoi(value);
+	if(GetParamValue(cmd, "ipv6",'6', NULL))
+		family = AF_INET6;
+	if(GetParamValue(cmd, "ipv4",'4', NULL))
+		family = AF_INET;
+
+	if(GetParamValue(cmd, "udp",'u', NULL) && !monitor->SetProbeType(PROBE_UDP)) {
+		WriteError("Unable to initialize the UDP backend: " + monitor->error + "\r\n");
+		return 1;
+	}
+	if(GetParamValue(cmd, "tcp",'t', value) && !monitor->SetProbeType(PROBE_TCP, TcpPort(value))) {
+		WriteError("Unable to initialize the TCP backend: " + monitor->error + "\r\n");
+		return 1;
+	}
+	if(!monitor->initialized) {
+		WriteError("Unable to initialize the probe backend: " + monitor->error + "\r\n");
+		return 1;
+	}
+	if(GetParamValue(cmd, "paris",'P', NULL) && !monitor->SetFlow(PARIS_FLOW)) {
+		WriteError("Unable to keep the probes in one flow with this backend.\r\n");
+		return 1;
+	}
+	std::string errors;
+	monitor->LoadTargets(filename, family, errors);
+	if(!errors.empty())
+		WriteError(errors);
+	if(!monitor->GetTargetCount()) {
+		WriteError("Usage: WinMTR --daemon targets.txt [--period SECONDS] [options]\r\n");
+		return 1;
+	}
+
+	bool ok = monitor->Run();
+	if(!ok)
+		WriteError("Unable to initialize the probe backend: " + monitor->error + "\r\n");
+	delete monitor;
+	return ok ? 0 : 1;
+}
+
+//*****************************************************************************
+// GetParamValue
+//
+//
+//*****************************************************************************
+int GetParamValue(const char* cmd, const char* param, char sparam, char* value)
+{
+	const char* p;
+
+	char p_long[1024];
+	char p_short[1024];
+
+	snprintf(p_long, sizeof(p_long), "--%s ", param);
+	snprintf(p_short, sizeof(p_short), "-%c ", sparam);
+
+	if((p=strstr(cmd, p_long))) ;
+	else
+		p=strstr(cmd, p_short);
+
+	if(p == NULL)
+		return 0;
+
+	if(!value)
+		return 1;
+
+	while(*p && *p!=' ')
+		p++;
+	while(*p==' ') p++;
+
+	int i = 0;
+	while(*p && *p!=' ' && i < 1023)
+		value[i++] = *p++;
+	value[i]='\0';
+
+	return 1;
+}
+
+//*****************************************************************************
+// GetHostNameParamValue
+//
+//
+//*****************************************************************************
+int GetHostNameParamValue(const char* cmd, std::string& host_name)
+{
+// WinMTR -h -i 1 -n google.com
+	size_t size = strlen(cmd);
+	std::string name = "";
+	while(size && cmd[size - 1] == ' ') size--;
+	if(!size)
+		return 0;
+
+	while(size-- && cmd[size] != ' ' && (cmd[size] != '-' || !size || cmd[size - 1] != ' ')) {
+		name = cmd[size ] + name;
+	}
+
+	if(size == (size_t)-1) {
+		if(name.length() == 0) {
+			return 0;
+		} else {
+			host_name = name;
+			return 1;
+		}
+	}
+	if(cmd[size] == '-' && cmd[size - 1] == ' ') {
+		// no target specified
+		return 0;
+	}
+
+	std::string possible_argument = "";
+
+	while(size-- && cmd[size] != ' ') {
+		possible_argument = cmd[size] + possible_argument;
+	}
+
+	if(possible_argument.length() && (possible_argument[0] != '-' || possible_argument == "-n" || possible_argument == "--numeric" || possible_argument == "-6" || possible_argument == "--ipv6" || possible_argument == "-4" || possible_argument == "--ipv4" || possible_argument == "-r" || possible_argument == "--report" || possible_argument == "-u" || possible_argument == "--udp" || possible_argument == "-P" || possible_argument == "--paris")) {
+		host_name = name;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,31 @@
+//*****************************************************************************
+// FILE:            WinMTRHeadless.h
+//
+// DESCRIPTION:     The modes that run without the dialog, --report and
+//                  --daemon, shared by WinMTRMain and the console build
+//
+//*****************************************************************************
+
+#ifndef WINMTRHEADLESS_H_
+#define WINMTRHEADLESS_H_
+
+#include <string>
+
+// cmd is the command line without the program name, ending in a space
+
+// 1 if cmd has --param or -sparam, its value copied to value if not NULL
+int GetParamValue(const char* cmd, const char* param, char sparam, char* value);
+
+// 1 if cmd ends in a host name, copied to host_name
+int GetHostNameParamValue(const char* cmd, std::string& host_name);
+
+// Text of the headless modes to stdout or stderr, on Windows the console of
+// the parent process when started without one
+void WriteOutput(const std::string& text);
+void WriteError(const std::string& text);
+
+// --report and --daemon, the exit code of the process
+int ReportMain(const char* cmd);
+int DaemonMain(const char* cmd);
+
+#endif // ifndef WINMTRHEADLESS_H_
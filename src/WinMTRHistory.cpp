@@ -0,0 +1,259 @@
+//*****************************************************************************
+// FILE:            WinMTRHistory.cpp
+//
+// DESCRIPTION:     Implementation of the columnar RTT history
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRHistory.h"
+#include <string.h>
+
+// rollup tiers, period in ms and the number of buckets kept
+static const struct {
+    ULONGLONG period;
+    int capacity;
+} TierLayout[HISTORY_TIERS] = {
+    { 1000, 3600 },     // 1 s for 1 hour
+    { 10000, 8640 },    // 10 s for 24 hours
+    { 60000, 1440 },    // 1 min for 24 hours
+    { 600000, 144 }     // 10 min for 24 hours
+};
+
+WinMTRHistory::WinMTRHistory(int capacity)
+{
+    m_capacity = capacity;
+    for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+        m_rtt[hop] = new unsigned short[capacity];
+        m_nameIds[hop] = new unsigned char[capacity];
+    }
+    m_validHops = new unsigned char[capacity];
+    m_timestamps = new ULONGLONG[capacity];
+    for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+        m_tiers[tier].period = TierLayout[tier].period;
+        m_tiers[tier].capacity = TierLayout[tier].capacity;
+        for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+            m_tiers[tier].buckets[hop] = new s_rollup[TierLayout[tier].capacity];
+        }
+    }
+    Clear();
+}
+
+WinMTRHistory::~WinMTRHistory()
+{
+    for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+        delete[] m_rtt[hop];
+        delete[] m_nameIds[hop];
+    }
+    delete[] m_validHops;
+    delete[] m_timestamps;
+    for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+        for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+            delete[] m_tiers[tier].buckets[hop];
+        }
+    }
+}
+
+void WinMTRHistory::Clear()
+{
+    m_head = 0;
+    m_size = 0;
+    m_serial = 0;
+    memset(m_names, 0, sizeof(m_names));
+    memset(m_nameRefs, 0, sizeof(m_nameRefs));
+    memset(m_lastNameId, 0, sizeof(m_lastNameId));
+    for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+        m_tiers[tier].first = 0;
+        m_tiers[tier].last = 0;
+        m_tiers[tier].empty = true;
+    }
+}
+
+void WinMTRHistory::Add(ULONGLONG timestamp, const int* rttValues, const char* const* hostnames, int numHops)
+{
+    int index;
+    if (m_size == m_capacity) {
+        // overwrite the oldest sample
+        index = m_head;
+        ReleaseSample(index);
+        if (++m_head == m_capacity) m_head = 0;
+    } else {
+        index = Index(m_size++);
+    }
+    m_serial++;
+
+    if (numHops > MAX_GRAPH_HOPS) numHops = MAX_GRAPH_HOPS;
+    m_timestamps[index] = timestamp;
+    m_validHops[index] = (unsigned char)numHops;
+
+    for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+        int rtt = hop < numHops ? rttValues[hop] : -1;
+        if (rtt < 0) m_rtt[hop][index] = HISTORY_NO_DATA;
+        else {
+            rtt = (rtt + HISTORY_RTT_UNIT / 2) / HISTORY_RTT_UNIT;
+            m_rtt[hop][index] = (unsigned short)(rtt < HISTORY_NO_DATA ? rtt : HISTORY_NO_DATA - 1);
+        }
+
+        const char* name = (hop < numHops && hostnames) ? hostnames[hop] : NULL;
+        unsigned char id = (name && *name) ? InternName(hop, name) : 0;
+        m_nameIds[hop][index] = id;
+        if (id) m_nameRefs[id]++;
+    }
+
+    AddToTiers(timestamp, index);
+}
+
+// Fold the sample at ring position index into the current bucket of every
+// tier. Buckets skipped because no sample arrived during them are cleared,
+// so a pause shows up as a gap.
+void WinMTRHistory::AddToTiers(ULONGLONG timestamp, int index)
+{
+    for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+        s_tier& t = m_tiers[tier];
+        ULONGLONG bucket = timestamp / t.period;
+        if (t.empty || bucket > t.last) {
+            ULONGLONG from = t.empty ? bucket : t.last + 1;
+            if (bucket - from >= (ULONGLONG)t.capacity) from = bucket - t.capacity + 1;
+            for (ULONGLONG b = from; b <= bucket; b++) {
+                for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+                    memset(&t.buckets[hop][b % t.capacity], 0, sizeof(s_rollup));
+                }
+            }
+            if (t.empty) t.first = bucket;
+            t.last = bucket;
+            t.empty = false;
+        }
+
+        // a timestamp older than the current bucket still counts towards it
+        int slot = (int)(t.last % t.capacity);
+        for (int hop = 0; hop < m_validHops[index]; hop++) {
+            s_rollup& r = t.buckets[hop][slot];
+            unsigned short rtt = m_rtt[hop][index];
+            r.samples++;
+            if (rtt == HISTORY_NO_DATA) continue;
+            if (r.replies == 0 || rtt < r.min) r.min = rtt;
+            if (r.replies == 0 || rtt > r.max) r.max = rtt;
+            r.sum += rtt;
+            r.replies++;
+        }
+    }
+}
+
+int WinMTRHistory::FindSample(ULONGLONG timestamp) const
+{
+    // timestamps only grow, binary search for the first one not older
+    int lo = 0, hi = m_size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (m_timestamps[Index(mid)] < timestamp) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Hostnames rarely change, so the id of the previous sample is tried first
+// and the table is only searched when the hop got a new name.
+unsigned char WinMTRHistory::InternName(int hop, const char* name)
+{
+    unsigned char last = m_lastNameId[hop];
+    if (last && strncmp(m_names[last], name, sizeof(m_names[0]) - 1) == 0) return last;
+
+    int freeId = 0;
+    for (int id = 1; id < MAX_HISTORY_NAMES; id++) {
+        if (m_nameRefs[id] == 0) {
+            if (!freeId) freeId = id;
+        } else if (strncmp(m_names[id], name, sizeof(m_names[0]) - 1) == 0) {
+            m_lastNameId[hop] = (unsigned char)id;
+            return (unsigned char)id;
+        }
+    }
+    if (!freeId) return 0;  // more distinct names than ids in the window, store none
+
+    strncpy(m_names[freeId], name, sizeof(m_names[0]) - 1);
+    m_names[freeId][sizeof(m_names[0]) - 1] = '\0';
+    m_lastNameId[hop] = (unsigned char)freeId;
+    return (unsigned char)freeId;
+}
+
+void WinMTRHistory::ReleaseSample(int index)
+{
+    for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+        unsigned char id = m_nameIds[hop][index];
+        if (id) m_nameRefs[id]--;
+    }
+}
+
+WinMTRHistoryWindow::WinMTRHistoryWindow(const WinMTRHistory& history)
+    : m_history(history)
+{
+    Clear();
+}
+
+void WinMTRHistoryWindow::Clear()
+{
+    m_start = m_end = m_history.Serial(0);
+    for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+        m_maxRtt[hop].clear();
+        m_dataCount[hop] = 0;
+        m_nameCount[hop] = 0;
+        m_latest[hop] = 0;
+    }
+    m_maxHops.clear();
+}
+
+void WinMTRHistoryWindow::Update(int start)
+{
+    ULONGLONG first = m_history.Serial(start);
+    if (first < m_start || first > m_end) {
+        // the start moved back, or past everything seen so far
+        Clear();
+        m_start = m_end = first;
+    }
+    while (m_start < first) Leave(m_start++);
+    while (m_end < m_history.Serial(m_history.Size())) Enter(m_end++);
+}
+
+void WinMTRHistoryWindow::DropOldest()
+{
+    if (m_start == m_history.Serial(0) && m_start < m_end) Leave(m_start++);
+}
+
+const char* WinMTRHistoryWindow::LatestHostname(int hop) const
+{
+    if (!m_dataCount[hop]) return "";
+    return m_history.Hostname(hop, m_history.IndexOf(m_latest[hop]));
+}
+
+void WinMTRHistoryWindow::Push(std::deque<s_entry>& dq, ULONGLONG serial, int value)
+{
+    // older entries that are not higher can never be the maximum again
+    while (!dq.empty() && dq.back().value <= value) dq.pop_back();
+    s_entry entry = { serial, value };
+    dq.push_back(entry);
+}
+
+void WinMTRHistoryWindow::Enter(ULONGLONG serial)
+{
+    int i = m_history.IndexOf(serial);
+    for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+        int rtt = m_history.Rtt(hop, i);
+        if (rtt >= 0) {
+            m_dataCount[hop]++;
+            m_latest[hop] = serial;
+            Push(m_maxRtt[hop], serial, rtt);
+        }
+        if (m_history.HasHostname(hop, i)) m_nameCount[hop]++;
+    }
+    Push(m_maxHops, serial, m_history.ValidHops(i));
+}
+
+void WinMTRHistoryWindow::Leave(ULONGLONG serial)
+{
+    int i = m_history.IndexOf(serial);
+    for (int hop = 0; hop < MAX_GRAPH_HOPS; hop++) {
+        if (m_history.Rtt(hop, i) >= 0) m_dataCount[hop]--;
+        if (m_history.HasHostname(hop, i)) m_nameCount[hop]--;
+        if (!m_maxRtt[hop].empty() && m_maxRtt[hop].front().serial == serial) m_maxRtt[hop].pop_front();
+    }
+    if (!m_maxHops.empty() && m_maxHops.front().serial == serial) m_maxHops.pop_front();
+}
@@ -0,0 +1,173 @@
+//*****************************************************************************
+// FILE:            WinMTRHistory.h
+//
+// DESCRIPTION:     Fixed-capacity RTT history behind WinMTRGraph. Samples are
+//                  stored column-wise per hop in a ring buffer, hostnames are
+//                  interned once and referenced by a one byte id. Rollup
+//                  tiers of 1 s, 10 s, 1 min and 10 min keep min/avg/max/loss
+//                  per hop for the long time spans.
+//
+//*****************************************************************************
+
+#ifndef WINMTRHISTORY_H_
+#define WINMTRHISTORY_H_
+
+#include <deque>
+
+#define MAX_GRAPH_HOPS 30
+#define MAX_HISTORY_SAMPLES 86400   // 24 hours at 1 sample/second
+#define MAX_HISTORY_NAMES 256       // interned hostnames, id 0 is the empty name
+#define HISTORY_NO_DATA 0xFFFF      // rtt column value of a hop without reply
+#define HISTORY_RTT_UNIT 100        // us per step of the stored RTTs, up to 6.5 s
+#define HISTORY_TIERS 4
+
+// min/avg/max/loss of one hop over one rollup period
+struct s_rollup {
+    unsigned short min;         // HISTORY_RTT_UNIT
+    unsigned short max;         // HISTORY_RTT_UNIT
+    unsigned int sum;           // of all replies, for the average
+    unsigned short replies;     // samples with an RTT
+    unsigned short samples;     // samples where the hop was part of the path, 0 = no data
+
+    int Avg() const { return replies ? sum / replies : -1; }
+    int Loss() const { return samples ? 100 - 100 * replies / samples : 0; }
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRHistory
+//
+// Sample i runs from 0 (oldest kept) to Size() - 1 (newest). Once the ring is
+// full every new sample overwrites the oldest one.
+//
+// Rollup buckets are numbered by time, bucket b of a tier covers the
+// timestamps [b * period, (b + 1) * period). Every tier is a ring of its own
+// and is updated as samples are added.
+//*****************************************************************************
+class WinMTRHistory
+{
+public:
+    WinMTRHistory(int capacity = MAX_HISTORY_SAMPLES);
+    ~WinMTRHistory();
+
+    // Append one sample of RTTs in us, rtt < 0 or a missing hop means no data
+    void Add(ULONGLONG timestamp, const int* rttValues, const char* const* hostnames, int numHops);
+    void Clear();
+
+    // RTTs and rollups are read back in HISTORY_RTT_UNIT
+    int Size() const { return m_size; }
+    int Capacity() const { return m_capacity; }
+
+    int Rtt(int hop, int i) const {
+        unsigned short rtt = m_rtt[hop][Index(i)];
+        return rtt == HISTORY_NO_DATA ? -1 : rtt;
+    }
+    const char* Hostname(int hop, int i) const { return m_names[m_nameIds[hop][Index(i)]]; }
+    bool HasHostname(int hop, int i) const { return m_nameIds[hop][Index(i)] != 0; }
+    int ValidHops(int i) const { return m_validHops[Index(i)]; }
+    ULONGLONG Timestamp(int i) const { return m_timestamps[Index(i)]; }
+
+    // First sample with a timestamp at or after the given one, Size() if none
+    int FindSample(ULONGLONG timestamp) const;
+
+    // Serial numbers count the samples added since Clear() and do not move
+    // when the ring drops its oldest sample
+    ULONGLONG Serial(int i) const { return m_serial - m_size + i; }
+    int IndexOf(ULONGLONG serial) const { return (int)(serial - (m_serial - m_size)); }
+
+    ULONGLONG TierPeriod(int tier) const { return m_tiers[tier].period; }
+    // Time span the tier keeps, in the unit of the timestamps
+    ULONGLONG TierSpan(int tier) const { return m_tiers[tier].period * m_tiers[tier].capacity; }
+    ULONGLONG LastBucket(int tier) const { return m_tiers[tier].last; }
+    ULONGLONG FirstBucket(int tier) const {
+        const s_tier& t = m_tiers[tier];
+        return t.last - t.first >= (ULONGLONG)t.capacity ? t.last - t.capacity + 1 : t.first;
+    }
+    const s_rollup& Rollup(int tier, int hop, ULONGLONG bucket) const {
+        return m_tiers[tier].buckets[hop][bucket % m_tiers[tier].capacity];
+    }
+
+private:
+    int Index(int i) const {
+        int index = m_head + i;
+        return index >= m_capacity ? index - m_capacity : index;
+    }
+    unsigned char InternName(int hop, const char* name);
+    void ReleaseSample(int index);
+    void AddToTiers(ULONGLONG timestamp, int index);
+
+    struct s_tier {
+        ULONGLONG period;
+        int capacity;
+        ULONGLONG first;        // first bucket since Clear()
+        ULONGLONG last;         // bucket being filled
+        bool empty;
+        s_rollup* buckets[MAX_GRAPH_HOPS];
+    };
+
+    int m_capacity;
+    int m_head;         // ring position of the oldest sample
+    int m_size;
+    ULONGLONG m_serial;     // samples added since Clear()
+
+    // columns, one entry per sample
+    unsigned short* m_rtt[MAX_GRAPH_HOPS];          // HISTORY_RTT_UNIT, HISTORY_NO_DATA if none
+    unsigned char* m_nameIds[MAX_GRAPH_HOPS];       // index into m_names
+    unsigned char* m_validHops;
+    ULONGLONG* m_timestamps;
+
+    s_tier m_tiers[HISTORY_TIERS];
+
+    // intern table, an id is free again once no sample references it
+    char m_names[MAX_HISTORY_NAMES][255];
+    int m_nameRefs[MAX_HISTORY_NAMES];
+    unsigned char m_lastNameId[MAX_GRAPH_HOPS];     // id stored for the previous sample of each hop
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRHistoryWindow
+//
+// Aggregates over the samples [start, Size()) of a history, kept up to date
+// as samples enter and leave the window: the highest RTT of every hop
+// (monotonic deque), whether a hop had replies or a hostname, and the
+// highest hop count. Both ends of the window may only move forward, moving
+// the start back rebuilds it.
+//*****************************************************************************
+class WinMTRHistoryWindow
+{
+public:
+    WinMTRHistoryWindow(const WinMTRHistory& history);
+
+    void Clear();
+    // Move the window to start at sample index start and take in new samples
+    void Update(int start);
+    // Let the oldest sample of a full history leave before Add() overwrites it
+    void DropOldest();
+
+    int MaxRtt(int hop) const { return m_maxRtt[hop].empty() ? 0 : m_maxRtt[hop].front().value; }
+    int MaxValidHops() const { return m_maxHops.empty() ? 0 : m_maxHops.front().value; }
+    bool HasData(int hop) const { return m_dataCount[hop] > 0; }
+    bool HasHostname(int hop) const { return m_nameCount[hop] > 0; }
+    // Hostname of the newest sample of the hop with a reply, "" if none
+    const char* LatestHostname(int hop) const;
+
+private:
+    struct s_entry {
+        ULONGLONG serial;
+        int value;
+    };
+    void Enter(ULONGLONG serial);
+    void Leave(ULONGLONG serial);
+    static void Push(std::deque<s_entry>& dq, ULONGLONG serial, int value);
+
+    const WinMTRHistory& m_history;
+    ULONGLONG m_start;      // serial of the first sample in the window
+    ULONGLONG m_end;        // serial after the last one
+
+    std::deque<s_entry> m_maxRtt[MAX_GRAPH_HOPS];   // falling values, front is the maximum
+    std::deque<s_entry> m_maxHops;
+    int m_dataCount[MAX_GRAPH_HOPS];
+    int m_nameCount[MAX_GRAPH_HOPS];
+    ULONGLONG m_latest[MAX_GRAPH_HOPS];             // serial of the newest reply
+};
+
+#endif // WINMTRHISTORY_H_
@@ -25,8 +25,7 @@
 #include "WinMTRMain.h"
 #include "WinMTRDialog.h"
 #include "WinMTRHelp.h"
-#include <algorithm>
-#include <iostream>
+#include "WinMTRHeadless.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -61,6 +60,14 @@ WinMTRMain::WinMTRMain()
 //*****************************************************************************
 BOOL WinMTRMain::InitInstance()
 {
+	if(strlen(m_lpCmdLine)) {
+		strcat(m_lpCmdLine," ");
+		if(GetParamValue(m_lpCmdLine, "report",'r', NULL))
+			return ReportMode(m_lpCmdLine);
+		if(GetParamValue(m_lpCmdLine, "daemon",'d', NULL))
+			return DaemonMode(m_lpCmdLine);
+	}
+	
 	INITCOMMONCONTROLSEX icex= {sizeof(INITCOMMONCONTROLSEX),ICC_STANDARD_CLASSES};
 	InitCommonControlsEx(&icex);
 	if(!AfxSocketInit()) {
@@ -75,7 +82,6 @@ BOOL WinMTRMain::InitInstance()
 	m_pMainWnd = &mtrDialog;
 	
 	if(strlen(m_lpCmdLine)) {
-		strcat(m_lpCmdLine," ");
 		ParseCommandLineParams(m_lpCmdLine, &mtrDialog);
 	}
 	
@@ -86,6 +92,33 @@ BOOL WinMTRMain::InitInstance()
 }
 
 
+//*****************************************************************************
+// WinMTRMain::ReportMode
+//
+// --report: trace without the dialog, see ReportMain(). None of the UI is
+// set up.
+//*****************************************************************************
+BOOL WinMTRMain::ReportMode(LPTSTR cmd)
+{
+	int code = ReportMain(cmd);
+	if(code)
+		exit(code);
+	return FALSE;
+}
+
+//*****************************************************************************
+// WinMTRMain::DaemonMode
+//
+// --daemon FILE, see DaemonMain().
+//*****************************************************************************
+BOOL WinMTRMain::DaemonMode(LPTSTR cmd)
+{
+	int code = DaemonMain(cmd);
+	if(code)
+		exit(code);
+	return FALSE;
+}
+
 //*****************************************************************************
 // WinMTRMain::ParseCommandLineParams
 //
@@ -131,84 +164,3 @@ void WinMTRMain::ParseCommandLineParams(LPTSTR cmd, WinMTRDialog* wmtrdlg)
 		wmtrdlg->useIPv6=0;
 	}
 }
-
-//*****************************************************************************
-// WinMTRMain::GetParamValue
-//
-//
-//*****************************************************************************
-int WinMTRMain::GetParamValue(LPTSTR cmd, char* param, char sparam, char* value)
-{
-	char* p;
-	
-	char p_long[1024];
-	char p_short[1024];
-	
-	sprintf(p_long,"--%s ", param);
-	sprintf(p_short,"-%c ", sparam);
-	
-	if((p=strstr(cmd, p_long))) ;
-	else
-		p=strstr(cmd, p_short);
-		
-	if(p == NULL)
-		return 0;
-		
-	if(!value)
-		return 1;
-		
-	while(*p && *p!=' ')
-		p++;
-	while(*p==' ') p++;
-	
-	int i = 0;
-	while(*p && *p!=' ')
-		value[i++] = *p++;
-	value[i]='\0';
-	
-	return 1;
-}
-
-//*****************************************************************************
-// WinMTRMain::GetHostNameParamValue
-//
-//
-//*****************************************************************************
-int WinMTRMain::GetHostNameParamValue(LPTSTR cmd, std::string& host_name)
-{
-// WinMTR -h -i 1 -n google.com
-	size_t size = strlen(cmd);
-	std::string name = "";
-	while(cmd[--size] == ' ');
-	
-	size++;
-	while(size-- && cmd[size] != ' ' && (cmd[size] != '-' || cmd[size - 1] != ' ')) {
-		name = cmd[size ] + name;
-	}
-	
-	if(size == -1) {
-		if(name.length() == 0) {
-			return 0;
-		} else {
-			host_name = name;
-			return 1;
-		}
-	}
-	if(cmd[size] == '-' && cmd[size - 1] == ' ') {
-		// no target specified
-		return 0;
-	}
-	
-	std::string possible_argument = "";
-	
-	while(size-- && cmd[size] != ' ') {
-		possible_argument = cmd[size] + possible_argument;
-	}
-	
-	if(possible_argument.length() && (possible_argument[0] != '-' || possible_argument == "-n" || possible_argument == "--numeric" || possible_argument == "-6" || possible_argument == "--ipv6" || possible_argument == "-4" || possible_argument == "--ipv4")) {
-		host_name = name;
-		return 1;
-	}
-	
-	return 0;
-}
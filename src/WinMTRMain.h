@@ -33,9 +33,9 @@ public:
 	DECLARE_MESSAGE_MAP()
 	
 private:
+	BOOL	ReportMode(LPTSTR cmd);
+	BOOL	DaemonMode(LPTSTR cmd);
 	void	ParseCommandLineParams(LPTSTR cmd, WinMTRDialog* wmtrdlg);
-	int		GetParamValue(LPTSTR cmd, char* param, char sparam, char* value);
-	int		GetHostNameParamValue(LPTSTR cmd, std::string& value);
 	
 };
 
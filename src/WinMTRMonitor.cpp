@@ -0,0 +1,446 @@
+//*****************************************************************************
+// FILE:            WinMTRMonitor.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRMonitor.h"
+#include "WinMTRResolver.h"
+
+#ifdef _WIN32
+#pragma comment(lib, "winmm.lib")	// timeBeginPeriod
+#endif
+
+#define MAX_REPLIES				64		// replies fetched from a backend per wait
+
+// s_timer::type of the timers in the wheel
+#define TIMER_PROBE				0		// index = family * MONITOR_SLOTS + probe table entry
+#define TIMER_ROUND				1		// index = target
+#define TIMER_REPORT			2
+
+static void SetErrorName(s_nethost& hop, DWORD status)
+{
+	if(!*hop.name)
+		strcpy(hop.name, WinMTRNet::ErrorName(status));
+}
+
+// true if the reply comes from the target itself
+static bool FromTarget(const s_montarget& t, const s_probe_reply& reply)
+{
+	return reply.addr.sin_family==AF_INET6 ?
+		   t.addr6.sin6_family==AF_INET6 && IN6_ARE_ADDR_EQUAL(&t.addr6.sin6_addr, &reply.addr6.sin6_addr) :
+		   t.addr.sin_family==AF_INET && t.addr.sin_addr.s_addr==reply.addr.sin_addr.s_addr;
+}
+
+WinMTRMonitor::WinMTRMonitor()
+{
+	pingsize = DEFAULT_PING_SIZE;
+	interval = DEFAULT_INTERVAL;
+	reportPeriod = 0;
+	onReport = NULL;
+	reportParam = NULL;
+	initialized = false;
+	running = false;
+	probeType = PROBE_ICMP;
+	probePort = TCP_DEFAULT_PORT;
+	flow = PROBE_FLOW_ANY;
+	for(int f=0; f<MONITOR_FAMILIES; ++f) {
+		family[f].probe = NULL;
+		family[f].slots = 0;
+	}
+	memset(&reportTimer,0,sizeof(reportTimer));
+	reportTimer.type = TIMER_REPORT;
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if(WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+		error = "Failed initializing windows sockets library!";
+		return;
+	}
+#endif
+	SetProbeType(PROBE_ICMP);
+}
+
+WinMTRMonitor::~WinMTRMonitor()
+{
+	for(int f=0; f<MONITOR_FAMILIES; ++f)
+		delete family[f].probe;
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+// the backends tell which families AddTarget() takes, Run() recreates them
+// with the probe tables sized for the targets
+bool WinMTRMonitor::SetProbeType(int type, WORD port)
+{
+	probeType = type;
+	probePort = port;
+	initialized = false;
+	for(int f=0; f<MONITOR_FAMILIES; ++f) {
+		delete family[f].probe;
+		family[f].probe = WinMTRProbe::Create(f ? AF_INET6 : AF_INET, MAX_INFLIGHT, type, port, f ? NULL : &error);
+		initialized = initialized || family[f].probe;// either family will do
+	}
+	return initialized;
+}
+
+bool WinMTRMonitor::SetFlow(int flow)
+{
+	this->flow = flow;
+	for(int f=0; f<MONITOR_FAMILIES; ++f)
+		if(family[f].probe && !family[f].probe->SetFlow(flow))
+			return false;
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRMonitor::AddTarget
+//
+//
+//*****************************************************************************
+bool WinMTRMonitor::AddTarget(const char* hostname, int af)
+{
+	std::vector<sockaddr_in6> addrs;
+	if(!WinMTRResolver::HostAddrs(hostname, family[1].probe ? af : AF_INET, addrs))
+		return false;
+
+	s_montarget target;
+	target.name = hostname;
+	target.addr6 = addrs[0]; //we use first address returned
+	if(!Family(target).probe)
+		return false;
+	target.reached = 0;
+	memset(&target.round,0,sizeof(target.round));
+	target.round.type = TIMER_ROUND;
+	target.round.index = (int)targets.size();
+	memset(target.hop,0,sizeof(target.hop));
+	targets.push_back(target);
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRMonitor::LoadTargets
+//
+// Returns the number of targets added.
+//*****************************************************************************
+int WinMTRMonitor::LoadTargets(const char* filename, int af, std::string& errors)
+{
+	FILE* file = fopen(filename, "r");
+	if(!file) {
+		errors += "Unable to open ";
+		errors += filename;
+		errors += "\r\n";
+		return 0;
+	}
+	int added = 0;
+	char line[1024];
+	while(fgets(line, sizeof(line), file)) {
+		char* comment = strchr(line, '#');
+		if(comment) *comment = '\0';
+		char* name = line;
+		while(isspace((unsigned char)*name)) ++name;
+		char* end = name + strlen(name);
+		while(end > name && isspace((unsigned char)end[-1])) --end;
+		*end = '\0';
+		if(!*name)
+			continue;
+		if(AddTarget(name, af)) {
+			++added;
+		} else {
+			errors += "Unable to resolve ";
+			errors += name;
+			errors += "\r\n";
+		}
+	}
+	fclose(file);
+	return added;
+}
+
+//*****************************************************************************
+// WinMTRMonitor::Run
+//
+// Single threaded like WinMTRNet::DoTrace. Each wakeup only handles the
+// timers that are due, whatever the number of targets.
+//*****************************************************************************
+bool WinMTRMonitor::Run()
+{
+	WinMTRProbe* probes[MONITOR_FAMILIES];
+	int nprobes = 0;
+	s_probe_reply replies[MAX_REPLIES];
+	ULONGLONG period = (ULONGLONG)((interval > MIN_INTERVAL ? interval : MIN_INTERVAL) * 1000000);
+	for(int f=0; f<MONITOR_FAMILIES; ++f) {
+		if(!SetupFamily(f))
+			return false;
+		if(family[f].probe) probes[nprobes++] = family[f].probe;
+	}
+	if(!nprobes)
+		return false;
+	data.assign(pingsize, 32);//whitespaces
+
+#ifdef _WIN32
+	timeBeginPeriod(1);
+#endif
+	ULONGLONG micros = GetTimeMicros();
+	ULONGLONG now = micros / 1000;
+	wheel.Start(now);
+	for(size_t i=0; i<targets.size(); ++i) {
+		s_montarget& t = targets[i];
+		t.pacing.start = micros + period * i / targets.size();
+		t.pacing.period = period;
+		t.pacing.slot = 0;
+		t.round.pprev = NULL;
+		wheel.Add(&t.round, WheelTick(t.pacing.start));
+	}
+	reportTimer.pprev = NULL;
+	if(onReport)
+		wheel.Add(&reportTimer, now + reportPeriod);
+
+	running = true;
+	while(running) {
+		micros = GetTimeMicros();
+		now = micros / 1000;
+		while(s_timer* timer = wheel.Expired(now)) {
+			switch(timer->type) {
+			case TIMER_PROBE: {
+				s_monfamily& fam = family[timer->index / MONITOR_SLOTS];
+				ExpireProbe(fam, &fam.probes[timer->index % MONITOR_SLOTS]);
+				break;
+			}
+			case TIMER_ROUND: {
+				s_montarget& t = targets[timer->index];
+				SendRound(timer->index, now);
+				PacingAdvance(t.pacing, micros);
+				wheel.Add(timer, WheelTick(PacingDeadline(t.pacing)));
+				break;
+			}
+			case TIMER_REPORT:
+				onReport(this, reportParam);
+				wheel.Add(timer, now + reportPeriod);
+				break;
+			}
+		}
+		// the rounds of all targets that were due in one send per family
+		for(int f=0; f<nprobes; ++f)
+			probes[f]->Flush();
+
+		WinMTRProbe::WaitAny(probes, nprobes, wheel.NextTimeout(now, ECHO_REPLY_TIMEOUT));
+		for(int f=0; f<MONITOR_FAMILIES; ++f) {
+			if(!family[f].probe) continue;
+			int count;
+			do {
+				count = family[f].probe->Wait(0, replies, MAX_REPLIES);
+				for(int i=0; i<count; ++i)
+					OnProbeReply(family[f], replies[i]);
+			} while(count == MAX_REPLIES);
+		}
+	}
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRMonitor::SetupFamily
+//
+// Recreates the backend of a family with a probe table for its targets:
+// every round has up to MAX_HOPS probes per target in flight until
+// ECHO_REPLY_TIMEOUT. A power of two, from MAX_INFLIGHT to MONITOR_SLOTS or
+// the slots of the backend, UDP probes have fewer ports; a full table skips
+// probes. A family without targets has no backend.
+//*****************************************************************************
+bool WinMTRMonitor::SetupFamily(int f)
+{
+	s_monfamily& fam = family[f];
+	int count = 0;
+	for(size_t i=0; i<targets.size(); ++i)
+		if(&Family(targets[i]) == &fam) ++count;
+	delete fam.probe;
+	fam.probe = NULL;
+	if(!count)
+		return true;
+
+	double period = (interval > MIN_INTERVAL ? interval : MIN_INTERVAL) * 1000;
+	double needed = (ceil(ECHO_REPLY_TIMEOUT / period) + 1) * MAX_HOPS * count;
+	fam.slots = MAX_INFLIGHT;
+	while(fam.slots < needed && fam.slots < MONITOR_SLOTS)
+		fam.slots <<= 1;
+	fam.probe = WinMTRProbe::Create(f ? AF_INET6 : AF_INET, fam.slots, probeType, probePort, &error);
+	if(!fam.probe)
+		return false;
+	fam.probe->SetFlow(flow);
+	if(fam.probe->GetSlots() < fam.slots)
+		fam.slots = fam.probe->GetSlots();
+
+	s_monprobe free;
+	memset(&free,0,sizeof(free));
+	free.timeout.type = TIMER_PROBE;
+	fam.probes.assign(fam.slots, free);
+	fam.freeSlots.resize(fam.slots);
+	fam.freeHead = 0;
+	fam.freeTail = 0;
+	fam.inflight = 0;
+	for(int i=0; i<fam.slots; ++i) {
+		fam.probes[i].timeout.index = f * MONITOR_SLOTS + i;
+		fam.freeSlots[fam.freeTail++] = (unsigned short)i;
+	}
+	return true;
+}
+
+void WinMTRMonitor::Stop()
+{
+	running = false;
+}
+
+//*****************************************************************************
+// WinMTRMonitor::SendRound
+//
+// One probe for every TTL of the target up to the destination. Until it
+// answered, up to MAX_UNKNOWN_HOSTS TTLs past the last hop that did, so
+// thousands of new targets don't fill the probe table with 30 probes each.
+//*****************************************************************************
+void WinMTRMonitor::SendRound(int target, ULONGLONG now)
+{
+	s_montarget& t = targets[target];
+	int max = t.reached;
+	if(!max) {
+		for(int at=0; at<MAX_HOPS; ++at)
+			if(t.hop[at].returned) max = at + 1;
+		max += MAX_UNKNOWN_HOSTS;
+		if(max > MAX_HOPS) max = MAX_HOPS;
+	}
+	for(int ttl=1; ttl<=max; ++ttl)
+		SendProbe(Family(t), target, ttl, now);
+}
+
+//*****************************************************************************
+// WinMTRMonitor::SendProbe
+//
+// Same as WinMTRNet::SendProbe on the table shared by all targets of the
+// family. The entry that was freed longest ago is taken, so a late reply
+// hardly ever finds its entry reused. A full table skips the probe without
+// counting it, so does a backend out of resources: the slot of the seq still
+// in use or no socket left is no loss at the hop.
+//*****************************************************************************
+void WinMTRMonitor::SendProbe(s_monfamily& fam, int target, int ttl, ULONGLONG now)
+{
+	if(fam.freeHead == fam.freeTail)
+		return;
+	unsigned short seq = fam.freeSlots[fam.freeHead++ & (fam.slots - 1)];
+	s_monprobe* entry = &fam.probes[seq];
+	s_montarget& t = targets[target];
+	entry->target = target;
+	entry->ttl = ttl;
+	entry->sent = now;
+
+	DWORD status = fam.probe->Send(seq, ttl, (sockaddr*)&t.addr6, data.empty() ? NULL : &data[0], (WORD)data.size());
+	if(status == IP_NO_RESOURCES) {
+		FreeProbe(fam, entry);
+		return;
+	}
+	if(status != IP_SUCCESS) {
+		WinMTRNet::RecordLoss(t.hop[ttl - 1]);
+		SetErrorName(t.hop[ttl - 1], status);
+		FreeProbe(fam, entry);
+		return;
+	}
+	wheel.Add(&entry->timeout, now + ECHO_REPLY_TIMEOUT);
+	++fam.inflight;
+}
+
+//*****************************************************************************
+// WinMTRMonitor::ExpireProbe
+//
+//
+//*****************************************************************************
+void WinMTRMonitor::ExpireProbe(s_monfamily& fam, s_monprobe* entry)
+{
+	s_nethost& hop = targets[entry->target].hop[entry->ttl - 1];
+	WinMTRNet::RecordLoss(hop);
+	SetErrorName(hop, IP_REQ_TIMED_OUT);
+	FreeProbe(fam, entry);
+	--fam.inflight;
+}
+
+void WinMTRMonitor::FreeProbe(s_monfamily& fam, s_monprobe* entry)
+{
+	entry->ttl = 0;
+	fam.freeSlots[fam.freeTail++ & (fam.slots - 1)] = (unsigned short)(entry - &fam.probes[0]);
+}
+
+//*****************************************************************************
+// WinMTRMonitor::OnProbeReply
+//
+// The seq of a reply later than ECHO_REPLY_TIMEOUT may belong to a probe of
+// another target by now. An answer of the destination that doesn't come from
+// the target of the entry is such a late one and dropped, the probe waits on.
+//*****************************************************************************
+void WinMTRMonitor::OnProbeReply(s_monfamily& fam, const s_probe_reply& reply)
+{
+	s_monprobe* entry = &fam.probes[reply.seq & (fam.slots - 1)];
+	if(!entry->ttl)
+		return;// already expired
+	s_montarget& t = targets[entry->target];
+	s_nethost& hop = t.hop[entry->ttl - 1];
+	switch(reply.status) {
+	case IP_SUCCESS:
+	case IP_DEST_PORT_UNREACHABLE:// a UDP probe reached the destination
+		if(!FromTarget(t, reply))
+			return;
+		if(!t.reached || entry->ttl < t.reached)
+			t.reached = entry->ttl;
+		WinMTRNet::RecordReply(hop, reply.rtt);
+		SetAddr(hop, reply);
+		break;
+	case IP_TTL_EXPIRED_TRANSIT:
+		if(entry->ttl == t.reached)
+			t.reached = 0;// the path got longer, look for the destination again
+		WinMTRNet::RecordReply(hop, reply.rtt);
+		SetAddr(hop, reply);
+		break;
+	default:
+		WinMTRNet::RecordLoss(hop);
+		SetErrorName(hop, reply.status);
+	}
+	wheel.Remove(&entry->timeout);
+	FreeProbe(fam, entry);
+	--fam.inflight;
+}
+
+//*****************************************************************************
+// WinMTRMonitor::SetAddr
+//
+// First responder of a hop. Hosts are shown by address, a resolver thread
+// per hop doesn't scale to thousands of targets.
+//*****************************************************************************
+void WinMTRMonitor::SetAddr(s_nethost& hop, const s_probe_reply& reply)
+{
+	if(hop.addr6.sin6_family)
+		return;
+	if(reply.addr.sin_family==AF_INET6)
+		hop.addr6 = reply.addr6;
+	else
+		hop.addr = reply.addr;
+	char hostname[NI_MAXHOST];
+	if(!getnameinfo((sockaddr*)&hop.addr6,sizeof(sockaddr_in6),hostname,NI_MAXHOST,NULL,0,NI_NUMERICHOST))
+		strcpy(hop.name, hostname);
+}
+
+//*****************************************************************************
+// WinMTRMonitor::Snapshot
+//
+// Hops up to the destination, or up to the last one that answered while it
+// wasn't reached. Only safe from the probe loop, i.e. from onReport.
+//*****************************************************************************
+void WinMTRMonitor::Snapshot(int target, s_pathsnapshot* path)
+{
+	const s_montarget& t = targets[target];
+	int count = t.reached;
+	if(!count) {
+		for(int at=0; at<MAX_HOPS; ++at)
+			if(t.hop[at].returned) count = at + 1;
+	}
+	WinMTRNet::FillSnapshot(t.hop, count, path);
+}
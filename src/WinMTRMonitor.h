@@ -0,0 +1,133 @@
+//*****************************************************************************
+// FILE:            WinMTRMonitor.h
+//
+//
+// DESCRIPTION:
+//   Traces many destinations at once for the --daemon mode. All targets share
+//   one probe loop and one probe backend per address family, each target only
+//   keeps its own hop table.
+//
+// NOTES:
+//   The probe table of a family is sized by Run() for its targets, up to
+//   MONITOR_SLOTS probes in flight, the whole 16 bit sequence space.
+//
+//*****************************************************************************
+
+#ifndef WINMTRMONITOR_H_
+#define WINMTRMONITOR_H_
+
+#include "WinMTRNet.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+#define MONITOR_SLOTS		65536	// most probes in flight per address family
+#define MONITOR_FAMILIES	2		// AF_INET, AF_INET6
+
+// one destination of the target list
+struct s_montarget {
+	std::string		name;		// as given in the target list
+	union {
+		sockaddr_in addr;
+		sockaddr_in6 addr6;
+	};
+	int				reached;	// lowest TTL the destination answered at, 0 = not yet
+	s_timer			round;		// next round of probes
+	s_pacing		pacing;		// when the rounds are due
+	struct s_nethost	hop[MAX_HOPS];
+};
+
+// one outstanding echo request of any target, its table index is its sequence number
+struct s_monprobe {
+	int				target;
+	int				ttl;		// 0 = free slot
+	ULONGLONG		sent;
+	s_timer			timeout;
+};
+
+// probe backend of one address family and the probes it has in flight
+struct s_monfamily {
+	WinMTRProbe*			probe;
+	int						slots;		// entries of probes and of the backend, a power of two
+	std::vector<s_monprobe>	probes;
+	std::vector<unsigned short>	freeSlots;	// ring of the free entries of probes, oldest first
+	DWORD					freeHead;
+	DWORD					freeTail;
+	int						inflight;
+};
+
+class WinMTRMonitor;
+
+// called from the probe loop every reportPeriod ms
+typedef void (*MonitorReportProc)(WinMTRMonitor* monitor, void* param);
+
+//*****************************************************************************
+// CLASS:  WinMTRMonitor
+//
+// Every target is probed once per interval on all TTLs up to the one its
+// destination answered at. The first rounds of the targets are spread over
+// one interval, so the probes go out evenly instead of in one burst. The
+// rounds and the probe timeouts are timers in one timing wheel, the targets
+// can't change while it runs.
+//*****************************************************************************
+
+class WinMTRMonitor
+{
+public:
+	WinMTRMonitor();
+	~WinMTRMonitor();
+
+	// resolves hostname and adds it, returns false if it can't be traced
+	bool	AddTarget(const char* hostname, int family);
+	// adds every host of a file with one host per line, # starts a comment;
+	// names that fail are appended to errors
+	int		LoadTargets(const char* filename, int family, std::string& errors);
+
+	// PROBE_ICMP, PROBE_UDP or PROBE_TCP to port, before the targets are
+	// added; returns false if this platform can't send them
+	bool	SetProbeType(int type, WORD port = TCP_DEFAULT_PORT);
+	// keeps the probes to every target in one flow, after SetProbeType(); see
+	// WinMTRNet::SetFlow()
+	bool	SetFlow(int flow);
+
+	// probe loop, returns after Stop(); false if the backends can't be set
+	// up for the targets, with the reason in error
+	bool	Run();
+	void	Stop();
+
+	int		GetTargetCount() const { return (int)targets.size(); }
+	const char* GetTargetName(int target) const { return targets[target].name.c_str(); }
+	// the statistics of one target, same as WinMTRNet::Snapshot()
+	void	Snapshot(int target, s_pathsnapshot* path);
+
+	// settings, before Run()
+	WORD				pingsize;
+	double				interval;
+	DWORD				reportPeriod;	// ms between calls of onReport
+	MonitorReportProc	onReport;
+	void*				reportParam;
+
+	bool				initialized;
+	std::string			error;			// why the backend didn't come up, for the caller to show
+private:
+	bool	SetupFamily(int f);
+	void	SendRound(int target, ULONGLONG now);
+	void	SendProbe(s_monfamily& fam, int target, int ttl, ULONGLONG now);
+	void	OnProbeReply(s_monfamily& fam, const s_probe_reply& reply);
+	void	ExpireProbe(s_monfamily& fam, s_monprobe* entry);
+	void	FreeProbe(s_monfamily& fam, s_monprobe* entry);
+	void	SetAddr(s_nethost& hop, const s_probe_reply& reply);
+	s_monfamily& Family(const s_montarget& target) { return family[target.addr.sin_family==AF_INET6 ? 1 : 0]; }
+
+	std::vector<s_montarget>	targets;
+	s_monfamily			family[MONITOR_FAMILIES];
+	int					probeType;		// of SetProbeType()
+	WORD				probePort;
+	int					flow;			// of SetFlow()
+	WinMTRTimerWheel	wheel;
+	s_timer				reportTimer;
+	std::vector<char>	data;
+	std::atomic<bool>	running;
+};
+
+#endif	// ifndef WINMTRMONITOR_H_
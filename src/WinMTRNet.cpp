@@ -4,300 +4,546 @@
 //*****************************************************************************
 #include "WinMTRGlobal.h"
 #include "WinMTRNet.h"
-#include "WinMTRDialog.h"
-#include <VersionHelpers.h>
+#include "WinMTRResolver.h"
+#include <cmath>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
 #ifdef _DEBUG
+#	ifdef _WIN32
+#		define TRACE_OUT(s)	OutputDebugString(s)
+#	else
+#		define TRACE_OUT(s)	std::cerr << (s)
+#	endif
 #	define TRACE_MSG(msg)										\
 	{															\
 		std::ostringstream dbg_msg(std::ostringstream::out);	\
 		dbg_msg << msg << std::endl;							\
-		OutputDebugString(dbg_msg.str().c_str());				\
+		TRACE_OUT(dbg_msg.str().c_str());						\
 	}
 #else
 #	define TRACE_MSG(msg)
 #endif
 
-#define IPFLAG_DONT_FRAGMENT	0x02
-#define MAX_HOPS				30
-
-struct trace_thread {
-	WinMTRNet*	winmtr;
-	in_addr		address;
-	int			ttl;
-};
-struct trace_thread6 {
-	WinMTRNet*		winmtr;
-	sockaddr_in6	address;
-	int				ttl;
-};
+#ifdef _WIN32
+#pragma comment(lib, "winmm.lib")	// timeBeginPeriod
+#endif
 
-struct dns_resolver_thread {
-	WinMTRNet*	winmtr;
-	int			index;
-};
+#define HOP_START_DELAY			30		// ms between the first probes of consecutive TTLs
+#define MAX_REPLIES				64		// replies fetched from the backend per wait
 
-unsigned WINAPI TraceThread(void* p);
-unsigned WINAPI TraceThread6(void* p);
-void DnsResolverThread(void* p);
+// s_timer::type of the timers in the wheel
+#define TIMER_PROBE				0		// index = probe table entry
+#define TIMER_SEND				1		// index = hop
 
-WinMTRNet::WinMTRNet(WinMTRDialog* wp)
+WinMTRNet::WinMTRNet()
 {
-
-	ghMutex = CreateMutex(NULL, FALSE, NULL);
-	hasIPv6=true;
-	tracing=false;
+	prober = NULL;
+	prober6 = NULL;
+	flow = PROBE_FLOW_ANY;
+	probeType = PROBE_ICMP;
+	probePort = TCP_DEFAULT_PORT;
+	multipath = false;
+	hasIPv6 = false;
+	tracing = false;
 	initialized = false;
-	wmtrdlg = wp;
-	WSADATA wsaData;
+	pingsize = DEFAULT_PING_SIZE;
+	interval = DEFAULT_INTERVAL;
+	useDNS = DEFAULT_DNS;
+	count = 0;
+	reached.store(0, std::memory_order_relaxed);
+	for(int at=0; at<MaxHost; ++at) hostSeq[at].store(0, std::memory_order_relaxed);
 	
+#ifdef _WIN32
+	WSADATA wsaData;
 	if(WSAStartup(MAKEWORD(2, 2), &wsaData)) {
-		AfxMessageBox("Failed initializing windows sockets library!");
-		return;
-	}
-	OSVERSIONINFOEX osvi= {0};
-	osvi.dwOSVersionInfoSize=sizeof(OSVERSIONINFOEX);
-	if(!IsWindows8OrGreater()) {
-		AfxMessageBox("Failed to get Windows version!");
+		error = "Failed initializing windows sockets library!";
 		return;
 	}
-	if(osvi.dwMajorVersion==5 && osvi.dwMinorVersion==0) { //w2k
-		hICMP_DLL=LoadLibrary(_T("ICMP.DLL"));
-		if(!hICMP_DLL) {
-			AfxMessageBox("Failed: Unable to locate ICMP.DLL!");
-			return;
-		}
-	} else {
-		hICMP_DLL=LoadLibrary(_T("Iphlpapi.dll"));
-		if(!hICMP_DLL) {
-			AfxMessageBox("Failed: Unable to locate Iphlpapi.dll!");
-			return;
-		}
-	}
-	
-	/*
-	 * Get pointers to ICMP.DLL functions
-	 */
-	//IPv4
-	lpfnIcmpCreateFile  = (LPFNICMPCREATEFILE)GetProcAddress(hICMP_DLL,"IcmpCreateFile");
-	lpfnIcmpCloseHandle = (LPFNICMPCLOSEHANDLE)GetProcAddress(hICMP_DLL,"IcmpCloseHandle");
-	lpfnIcmpSendEcho2   = (LPFNICMPSENDECHO2)GetProcAddress(hICMP_DLL,"IcmpSendEcho2");
-	if(!lpfnIcmpCreateFile || !lpfnIcmpCloseHandle || !lpfnIcmpSendEcho2) {
-		AfxMessageBox("Wrong ICMP system library !");
-		return;
+#endif
+	ResetHops();
+	memset(probes,0,sizeof(probes));
+	for(int i=0; i<TRACE_SLOTS; ++i) {
+		probes[i].timeout.type = TIMER_PROBE;
+		probes[i].timeout.index = i;
 	}
-	//IPv6
-	lpfnIcmp6CreateFile=(LPFNICMP6CREATEFILE)GetProcAddress(hICMP_DLL,"Icmp6CreateFile");
-	lpfnIcmp6SendEcho2=(LPFNICMP6SENDECHO2)GetProcAddress(hICMP_DLL,"Icmp6SendEcho2");
-	if(!lpfnIcmp6CreateFile || !lpfnIcmp6SendEcho2) {
-		hasIPv6=false;
-		AfxMessageBox("IPv6 support not found!");
-		return;//@todo : soft fail
+	memset(sendTimer,0,sizeof(sendTimer));
+	for(int i=0; i<MAX_HOPS; ++i) {
+		sendTimer[i].type = TIMER_SEND;
+		sendTimer[i].index = i;
 	}
+	nextSeq = 0;
+	inflight = 0;
 	
-	/*
-	 * IcmpCreateFile() - Open the ping service
-	 */
-	hICMP = (HANDLE) lpfnIcmpCreateFile();
-	if(hICMP == INVALID_HANDLE_VALUE) {
-		AfxMessageBox("Error in ICMP module!");
-		return;
+	slots = TraceSlots();
+	SetProbeType(PROBE_ICMP);
+}
+
+WinMTRNet::~WinMTRNet()
+{
+	WinMTRResolver::Shared().Cancel(this);
+	delete prober6;
+	delete prober;
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+//*****************************************************************************
+// WinMTRNet::SetProbeType
+//
+// Not while a trace is running. initialized follows the last type, the
+// ICMP backend isn't needed for UDP or TCP probes.
+//*****************************************************************************
+bool WinMTRNet::SetProbeType(int type, WORD port)
+{
+	probeType = type;
+	probePort = port;
+	delete prober6;
+	delete prober;
+	prober = WinMTRProbe::Create(AF_INET, slots, type, port, &error);
+	prober6 = WinMTRProbe::Create(AF_INET6, slots, type, port);
+	hasIPv6 = prober6 != NULL;	// IPv4 keeps working without it
+	initialized = prober != NULL;
+	return initialized && SetFlow(flow);
+}
+
+bool WinMTRNet::SetFlow(int flow)
+{
+	this->flow = flow;
+	if(prober6 && !prober6->SetFlow(flow))
+		return false;
+	return prober && prober->SetFlow(flow);
+}
+
+//*****************************************************************************
+// WinMTRNet::SetMultipath
+//
+// The stopping rule of the Multipath Detection Algorithm: if a TTL has k
+// responders and they are equally likely, n(k) answered flows that all went
+// to them miss a k+1st with probability (k/(k+1))^n(k). That has to be below
+// alpha/(k+1), 1 - confidence shared out over the responders there may be.
+//*****************************************************************************
+bool WinMTRNet::SetMultipath(double confidence)
+{
+	multipath = false;
+	if(confidence <= 0)
+		return true;
+	// only ICMP probes can be kept in a flow, UDP and TCP backends refuse it
+	bool flows = prober && prober->SetFlow(0) && (!prober6 || prober6->SetFlow(0));
+	SetFlow(flow);
+	if(!flows || confidence >= 1)
+		return false;
+	double alpha = 1 - confidence;
+	mdaStop[0] = 1;// one answer to start with
+	for(int k=1; k<MDA_MAX_RESPONDERS; ++k)
+		mdaStop[k] = (int)ceil(log(alpha / (k + 1)) / log(k / (k + 1.0)));
+	mdaStop[MDA_MAX_RESPONDERS] = 0;// no room for more
+	multipath = true;
+	return true;
+}
+
+void WinMTRNet::ResetHops()
+{
+	WinMTRResolver::Shared().Cancel(this);// names of the previous trace
+	reached.store(0, std::memory_order_relaxed);
+	for(int at=0; at<MaxHost; ++at) {
+		BeginHopWrite(at);
+		memset(&host[at],0,sizeof(s_nethost));
+		EndHopWrite(at);
 	}
-	if(hasIPv6) {
-		hICMP6=(HANDLE)lpfnIcmp6CreateFile();
-		if(hICMP6==INVALID_HANDLE_VALUE) {
-			AfxMessageBox("Error in ICMPv6 module!");
-			return;//@todo : soft fail
-		}
+	for(int at=0; at<MAX_HOPS; ++at) {
+		memset(&recent[at],0,sizeof(s_pinghistory));
+		recent[at].lastRtt = -1;
+		BeginHopWrite(at);
+		memset(responder[at],0,sizeof(responder[at]));
+		responders[at] = 0;
+		EndHopWrite(at);
+		memset(&mda[at],0,sizeof(s_mdahop));
 	}
-	
-	ResetHops();
-	
-	initialized = true;
-	return;
 }
 
-WinMTRNet::~WinMTRNet()
+//*****************************************************************************
+// Per-hop seqlock
+//
+// Writers make the hop's sequence odd while they change it, readers copy the
+// hop and retry if the sequence was odd or moved meanwhile. The probe loop is
+// the only writer of the counters; the CAS only serializes it against the
+// resolver threads setting a name.
+//*****************************************************************************
+void WinMTRNet::BeginHopWrite(int at)
 {
-	if(initialized) {
-		/*
-		 * IcmpCloseHandle - Close the ICMP handle
-		 */
-		if(hasIPv6) lpfnIcmpCloseHandle(hICMP6);
-		lpfnIcmpCloseHandle(hICMP);
-		
-		// Shut down...
-		FreeLibrary(hICMP_DLL);
-		
-		WSACleanup();
-		
-		CloseHandle(ghMutex);
+	unsigned seq = hostSeq[at].load(std::memory_order_relaxed);
+	while((seq & 1) || !hostSeq[at].compare_exchange_weak(seq, seq + 1, std::memory_order_acquire)) {
+		std::this_thread::yield();
+		seq = hostSeq[at].load(std::memory_order_relaxed);
 	}
+	std::atomic_thread_fence(std::memory_order_release);
 }
 
-void WinMTRNet::ResetHops()
+void WinMTRNet::EndHopWrite(int at)
 {
-	memset(host,0,sizeof(host));
+	hostSeq[at].fetch_add(1, std::memory_order_release);
 }
 
-void WinMTRNet::DoTrace(sockaddr* sockaddr)
+void WinMTRNet::ReadHop(int at, s_nethost* hop)
 {
-	HANDLE hThreads[MAX_HOPS];
-	unsigned char hops=0;
-	tracing = true;
-	ResetHops();
-	if(sockaddr->sa_family==AF_INET6) {
-		host[0].addr6.sin6_family=AF_INET6;
-		last_remote_addr6=((sockaddr_in6*)sockaddr)->sin6_addr;
-		for(; hops<MAX_HOPS;) {// one thread per TTL value
-			trace_thread6* current=new trace_thread6;
-			current->address=*(sockaddr_in6*)sockaddr;
-			current->winmtr=this;
-			current->ttl=hops+1;
-			hThreads[hops]=(HANDLE)_beginthreadex(NULL,0,TraceThread6,current,0,NULL);
-			Sleep(30);
-			if(++hops>this->GetMax()) break;
-		}
-	} else {
-		host[0].addr.sin_family=AF_INET;
-		last_remote_addr=((sockaddr_in*)sockaddr)->sin_addr;
-		for(; hops<MAX_HOPS;) {// one thread per TTL value
-			trace_thread* current=new trace_thread;
-			current->address=((sockaddr_in*)sockaddr)->sin_addr;
-			current->winmtr=this;
-			current->ttl=hops+1;
-			hThreads[hops]=(HANDLE)_beginthreadex(NULL,0,TraceThread,current,0,NULL);
-			Sleep(30);
-			if(++hops>this->GetMax()) break;
+	unsigned seq;
+	for(;;) {
+		seq = hostSeq[at].load(std::memory_order_acquire);
+		if(!(seq & 1)) {
+			memcpy(hop, &host[at], sizeof(s_nethost));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(hostSeq[at].load(std::memory_order_relaxed) == seq)
+				return;
 		}
+		std::this_thread::yield();
 	}
-	WaitForMultipleObjects(hops, hThreads, TRUE, INFINITE);
-	for(; hops;) CloseHandle(hThreads[--hops]);
 }
 
-void WinMTRNet::StopTrace()
+// the responders of a hop in multipath mode, returns their number
+int WinMTRNet::ReadResponders(int at, s_nethost* hops)
 {
-	tracing = false;
+	unsigned seq;
+	for(;;) {
+		seq = hostSeq[at].load(std::memory_order_acquire);
+		if(!(seq & 1)) {
+			int count = responders[at];
+			memcpy(hops, responder[at], sizeof(s_nethost) * count);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(hostSeq[at].load(std::memory_order_relaxed) == seq)
+				return count;
+		}
+		std::this_thread::yield();
+	}
 }
 
-unsigned WINAPI TraceThread(void* p)
+//*****************************************************************************
+// WinMTRNet::DoTrace
+//
+// Single threaded probe loop. Every TTL is probed once per interval, all
+// requests are sent asynchronously and the backend hands their replies back
+// while this thread waits in WinMTRProbe::Wait(). The timing wheel holds the
+// next probe of every TTL and the timeout of every probe in flight, the wait
+// ends with the first of them. With count set every TTL is probed count
+// times and the trace ends once all of them are answered or timed out.
+//*****************************************************************************
+void WinMTRNet::DoTrace(sockaddr* sockaddr)
 {
-	trace_thread* current = (trace_thread*)p;
-	WinMTRNet* wmtrnet = current->winmtr;
-	TRACE_MSG("Thread with TTL=" << (int)current->ttl << " started.");
-	
-	IPINFO			stIPInfo, *lpstIPInfo;
-	char			achReqData[8192];
-	WORD			nDataLen = wmtrnet->wmtrdlg->pingsize;
-	union {
-		ICMP_ECHO_REPLY icmp_echo_reply;
-		char achRepData[sizeof(ICMPECHO)+8192];
-	};
+	int sent[MAX_HOPS];
+	s_probe_reply replies[MAX_REPLIES];
+	WORD nDataLen = pingsize;
+	s_pacing pacing[MAX_HOPS];
+	ULONGLONG period = (ULONGLONG)(TraceInterval() * 1000000);
+	if(TraceSlots() != slots) {
+		// backends sized for this interval, a table for MIN_INTERVAL costs the
+		// Windows one a reply buffer per entry
+		slots = TraceSlots();
+		SetProbeType(probeType, probePort);
+	}
+	WinMTRProbe* probe = sockaddr->sa_family==AF_INET6 ? prober6 : prober;
+	tracing = true;
+	ResetHops();
+	BeginHopWrite(0);
+	if(sockaddr->sa_family==AF_INET6)
+		host[0].addr6.sin6_family=AF_INET6;
+	else
+		host[0].addr.sin_family=AF_INET;
+	EndHopWrite(0);
+	if(!probe) {
+		tracing = false;
+		return;
+	}
 	
-	lpstIPInfo				= &stIPInfo;
-	stIPInfo.Ttl			= (UCHAR)current->ttl;
-	stIPInfo.Tos			= 0;
-	stIPInfo.Flags			= IPFLAG_DONT_FRAGMENT;
-	stIPInfo.OptionsSize	= 0;
-	stIPInfo.OptionsData	= NULL;
+	char* achReqData = new char[nDataLen];
 	for(int i=0; i<nDataLen; ++i) achReqData[i]=32;//whitespaces
-	while(wmtrnet->tracing) {
-		// For some strange reason, ICMP API is not filling the TTL for icmp echo reply
-		// Check if the current thread should be closed
-		if(current->ttl > wmtrnet->GetMax()) break;
-		// NOTE: some servers does not respond back everytime, if TTL expires in transit; e.g. :
-		// ping -n 20 -w 5000 -l 64 -i 7 www.chinapost.com.tw  -> less that half of the replies are coming back from 219.80.240.93
-		// but if we are pinging ping -n 20 -w 5000 -l 64 219.80.240.93  we have 0% loss
-		// A resolution would be:
-		// - as soon as we get a hop, we start pinging directly that hop, with a greater TTL
-		// - a drawback would be that, some servers are configured to reply for TTL transit expire, but not to ping requests, so,
-		// for these servers we'll have 100% loss
-		DWORD dwReplyCount = wmtrnet->lpfnIcmpSendEcho2(wmtrnet->hICMP, 0,NULL,NULL, current->address, achReqData, nDataLen, lpstIPInfo, achRepData, sizeof(achRepData), ECHO_REPLY_TIMEOUT);
-		wmtrnet->AddXmit(current->ttl - 1);
-		if(dwReplyCount) {
-			TRACE_MSG("TTL " << (int)current->ttl << " reply TTL " << (int)icmp_echo_reply.Options.Ttl << " Status " << icmp_echo_reply.Status << " Reply count " << dwReplyCount);
-			switch(icmp_echo_reply.Status) {
-			case IP_SUCCESS:
-			case IP_TTL_EXPIRED_TRANSIT:
-				wmtrnet->UpdateRTT(current->ttl - 1, icmp_echo_reply.RoundTripTime);
-				wmtrnet->AddReturned(current->ttl - 1);
-				wmtrnet->SetAddr(current->ttl - 1, icmp_echo_reply.Address);
-				break;
-			default:
-				wmtrnet->SetErrorName(current->ttl - 1, icmp_echo_reply.Status);
+	
+#ifdef _WIN32
+	timeBeginPeriod(1);// waits to the millisecond instead of the 15.6 ms default
+#endif
+	ULONGLONG micros = GetTimeMicros();
+	ULONGLONG now = micros / 1000;
+	wheel.Start(now);
+	for(int i=0; i<MAX_HOPS; ++i) {
+		pacing[i].start = micros + i * HOP_START_DELAY * 1000;
+		pacing[i].period = period;
+		pacing[i].slot = 0;
+		sendTimer[i].pprev = NULL;
+		wheel.Add(&sendTimer[i], WheelTick(pacing[i].start));
+		sent[i] = 0;
+	}
+	int max = 0;
+	
+	while(tracing || inflight) {
+		micros = GetTimeMicros();
+		now = micros / 1000;
+		int newmax = GetMax();
+		// TTLs that were past the end of the path wait for their turn again
+		for(int at=max; at<newmax; ++at)
+			if(!WinMTRTimerWheel::Pending(&sendTimer[at]) && (!count || sent[at] < count))
+				wheel.Add(&sendTimer[at], now);
+		// and those past the destination stop right away
+		for(int at=newmax; at<max; ++at)
+			wheel.Remove(&sendTimer[at]);
+		max = newmax;
+		
+		while(s_timer* timer = wheel.Expired(now)) {
+			if(timer->type == TIMER_PROBE) {
+				ExpireProbe(&probes[timer->index]);
+				continue;
 			}
-			if((DWORD)(wmtrnet->wmtrdlg->interval * 1000) > icmp_echo_reply.RoundTripTime)
-				Sleep((DWORD)(wmtrnet->wmtrdlg->interval * 1000) - icmp_echo_reply.RoundTripTime);
-		} else {
-			DWORD err=GetLastError();
-			wmtrnet->SetErrorName(current->ttl - 1, err);
-			switch(err) {
-			case IP_REQ_TIMED_OUT: break;
-			default:
-				Sleep((DWORD)(wmtrnet->wmtrdlg->interval * 1000));
+			int at = timer->index;
+			if(!tracing || at >= max)
+				continue;
+			if(multipath)
+				SendMultipath(probe, at, sockaddr, achReqData, nDataLen, now);
+			else
+				SendProbe(probe, at + 1, sockaddr, achReqData, nDataLen, now);
+			if(PacingAdvance(pacing[at], micros)) {
+				TRACE_MSG("TTL " << at + 1 << " fell behind, skipped to slot " << pacing[at].slot);
 			}
+			if(!count || ++sent[at] < count)
+				wheel.Add(timer, WheelTick(PacingDeadline(pacing[at])));
 		}
-	}//end loop
-	TRACE_MSG("Thread with TTL=" << (int)current->ttl << " stopped.");
-	delete p;
-	return 0;
+		probe->Flush();
+		if(tracing && count) {
+			bool done = true;
+			for(int at=0; at<max && done; ++at)
+				done = sent[at] >= count;
+			// with no reply pending the path can't grow any more
+			if(done && !inflight) break;
+		}
+		int replied = probe->Wait(wheel.NextTimeout(now, ECHO_REPLY_TIMEOUT), replies, MAX_REPLIES);
+		for(int i=0; i<replied; ++i)
+			OnProbeReply(replies[i]);
+	}
+	tracing = false;
+	probe->SetFlow(flow);// of SetFlow(), multipath changes it per probe
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+	
+	delete[] achReqData;
 }
 
-unsigned WINAPI TraceThread6(void* p)
+//*****************************************************************************
+// WinMTRNet::SendProbe
+//
+// Claim the table entry for the next sequence number and hand the echo
+// request to the backend. Returns false if the probe wasn't sent.
+//*****************************************************************************
+bool WinMTRNet::SendProbe(WinMTRProbe* probe, int ttl, sockaddr* sockaddr, const char* data, WORD size, ULONGLONG now, int flow, bool discovery)
 {
-	static sockaddr_in6 sockaddrfrom= {AF_INET6,0,0,in6addr_any,0};
-	trace_thread6* current = (trace_thread6*)p;
-	WinMTRNet* wmtrnet = current->winmtr;
-	TRACE_MSG("Thread with TTL=" << (int)current->ttl << " started.");
-	
-	IPINFO			stIPInfo, *lpstIPInfo;
-	char			achReqData[8192];
-	WORD			nDataLen = wmtrnet->wmtrdlg->pingsize;
-	union {
-		ICMPV6_ECHO_REPLY icmpv6_echo_reply;
-		char achRepData[sizeof(PICMPV6_ECHO_REPLY) + 8192];
-	};
+	s_probe* entry = &probes[nextSeq & (slots - 1)];
+	if(entry->ttl) {
+		TRACE_MSG("Probe table full, skipping TTL " << ttl);
+		return false;
+	}
+	entry->seq = nextSeq;
+	entry->ttl = ttl;
+	entry->sent = now;
+	entry->flow = flow;
+	entry->discovery = false;
 	
-	lpstIPInfo				= &stIPInfo;
-	stIPInfo.Ttl			= (UCHAR)current->ttl;
-	stIPInfo.Tos			= 0;
-	stIPInfo.Flags			= IPFLAG_DONT_FRAGMENT;
-	stIPInfo.OptionsSize	= 0;
-	stIPInfo.OptionsData	= NULL;
-	for(int i=0; i<nDataLen; ++i) achReqData[i]=32;//whitespaces
-	while(wmtrnet->tracing) {
-		if(current->ttl > wmtrnet->GetMax()) break;
-		DWORD dwReplyCount = wmtrnet->lpfnIcmp6SendEcho2(wmtrnet->hICMP6, 0,NULL,NULL, &sockaddrfrom, &current->address, achReqData, nDataLen, lpstIPInfo, achRepData, sizeof(achRepData), ECHO_REPLY_TIMEOUT);
-		wmtrnet->AddXmit(current->ttl - 1);
-		if(dwReplyCount) {
-			TRACE_MSG("TTL " << (int)current->ttl << " Status " << icmpv6_echo_reply.Status << " Reply count " << dwReplyCount);
-			switch(icmpv6_echo_reply.Status) {
-			case IP_SUCCESS:
-			case IP_TTL_EXPIRED_TRANSIT:
-				wmtrnet->UpdateRTT(current->ttl - 1, icmpv6_echo_reply.RoundTripTime);
-				wmtrnet->AddReturned(current->ttl - 1);
-				wmtrnet->SetAddr6(current->ttl - 1, icmpv6_echo_reply.Address);
-				break;
-			default:
-				wmtrnet->SetErrorName(current->ttl - 1, icmpv6_echo_reply.Status);
-			}
-			if((DWORD)(wmtrnet->wmtrdlg->interval * 1000) > icmpv6_echo_reply.RoundTripTime)
-				Sleep((DWORD)(wmtrnet->wmtrdlg->interval * 1000) - icmpv6_echo_reply.RoundTripTime);
+	if(flow != PROBE_FLOW_ANY)
+		probe->SetFlow(flow);
+	DWORD status = probe->Send(nextSeq++, ttl, sockaddr, data, size);
+	if(status != IP_SUCCESS) {
+		// request failed right away, no reply will come for it
+		AddXmit(ttl - 1, now);
+		SetErrorName(ttl - 1, status);
+		entry->ttl = 0;
+		return false;
+	}
+	wheel.Add(&entry->timeout, now + ECHO_REPLY_TIMEOUT);
+	++inflight;
+	if(discovery) {
+		entry->discovery = true;
+		++mda[ttl - 1].pending;
+	}
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRNet::SendMultipath
+//
+// Until the responders of a TTL are all known every probe goes in a new
+// flow, up to MDA_BURST at once so the first rounds find most of them.
+// After that the probes go in the flows that found each responder, in turn,
+// and a new responder showing up starts the search again.
+//*****************************************************************************
+void WinMTRNet::SendMultipath(WinMTRProbe* probe, int at, sockaddr* sockaddr, const char* data, WORD size, ULONGLONG now)
+{
+	s_mdahop& hop = mda[at];
+	int k = responders[at];// only the probe loop writes it
+	if(k && hop.answered + hop.pending >= mdaStop[k]) {
+		hop.turn = (hop.turn + 1) % k;
+		SendProbe(probe, at + 1, sockaddr, data, size, now, hop.flow[hop.turn]);
+		return;
+	}
+	do {
+		if(!SendProbe(probe, at + 1, sockaddr, data, size, now, hop.next, true))
+			break;
+		hop.next = (hop.next + 1) & 0xFFFF;
+	} while(hop.pending < MDA_BURST && hop.answered + hop.pending < mdaStop[k]);
+}
+
+// Probe table entries for the interval: every TTL has a probe in flight per
+// interval until ECHO_REPLY_TIMEOUT, up to MDA_BURST in multipath mode. A
+// power of two, from MAX_INFLIGHT to TRACE_SLOTS.
+int WinMTRNet::TraceSlots()
+{
+	double period = TraceInterval() * 1000;
+	int needed = ((int)ceil(ECHO_REPLY_TIMEOUT / period) + 1) * MAX_HOPS * (multipath ? MDA_BURST : 1);
+	int n = MAX_INFLIGHT;
+	while(n < needed && n < TRACE_SLOTS)
+		n <<= 1;
+	return n;
+}
+
+// the interval in seconds, raised to MIN_INTERVAL, or to MDA_MIN_INTERVAL in
+// multipath mode so the bursts of every TTL still fit in the probe table
+double WinMTRNet::TraceInterval()
+{
+	double shortest = multipath ? MDA_MIN_INTERVAL : MIN_INTERVAL;
+	return interval > shortest ? interval : shortest;
+}
+
+//*****************************************************************************
+// WinMTRNet::ExpireProbe
+//
+//
+//*****************************************************************************
+void WinMTRNet::ExpireProbe(s_probe* entry)
+{
+	TRACE_MSG("TTL " << entry->ttl << " seq " << entry->seq << " timed out");
+	AddXmit(entry->ttl - 1, entry->sent);
+	SetErrorName(entry->ttl - 1, IP_REQ_TIMED_OUT);
+	if(multipath)
+		AddResponderLoss(entry->ttl - 1, entry);
+	entry->ttl = 0;
+	--inflight;
+}
+
+//*****************************************************************************
+// WinMTRNet::OnProbeReply
+//
+//
+//*****************************************************************************
+void WinMTRNet::OnProbeReply(const s_probe_reply& reply)
+{
+	s_probe* entry = &probes[reply.seq & (slots - 1)];
+	if(!entry->ttl || entry->seq != reply.seq)
+		return;// already expired, or a late reply from a previous trace
+	int at = entry->ttl - 1;
+	// For some strange reason, ICMP API is not filling the TTL for icmp echo reply
+	// NOTE: some servers does not respond back everytime, if TTL expires in transit; e.g. :
+	// ping -n 20 -w 5000 -l 64 -i 7 www.chinapost.com.tw  -> less that half of the replies are coming back from 219.80.240.93
+	// but if we are pinging ping -n 20 -w 5000 -l 64 219.80.240.93  we have 0% loss
+	// A resolution would be:
+	// - as soon as we get a hop, we start pinging directly that hop, with a greater TTL
+	// - a drawback would be that, some servers are configured to reply for TTL transit expire, but not to ping requests, so,
+	// for these servers we'll have 100% loss
+	TRACE_MSG("TTL " << entry->ttl << " seq " << entry->seq << " Status " << reply.status);
+	switch(reply.status) {
+	case IP_SUCCESS:
+	case IP_DEST_PORT_UNREACHABLE:// a UDP probe reached the destination
+		if(!reached.load(std::memory_order_relaxed) || entry->ttl < reached.load(std::memory_order_relaxed))
+			reached.store(entry->ttl, std::memory_order_relaxed);
+		AddReply(at, reply.rtt, entry->sent);
+		if(reply.addr.sin_family==AF_INET6)
+			SetAddr6(at, reply.addr6.sin6_addr);
+		else
+			SetAddr(at, reply.addr.sin_addr.s_addr);
+		if(multipath)
+			AddResponderReply(at, reply, entry);
+		break;
+	case IP_TTL_EXPIRED_TRANSIT:
+		if(entry->ttl == reached.load(std::memory_order_relaxed))
+			reached.store(0, std::memory_order_relaxed);// the path got longer, look for the destination again
+		AddReply(at, reply.rtt, entry->sent);
+		if(reply.addr.sin_family==AF_INET6)
+			SetAddr6(at, reply.addr6.sin6_addr);
+		else
+			SetAddr(at, reply.addr.sin_addr.s_addr);
+		if(multipath)
+			AddResponderReply(at, reply, entry);
+		break;
+	default:
+		AddXmit(at, entry->sent);
+		SetErrorName(at, reply.status);
+		if(multipath)
+			AddResponderLoss(at, entry);
+	}
+	wheel.Remove(&entry->timeout);
+	entry->ttl = 0;
+	--inflight;
+}
+
+//*****************************************************************************
+// WinMTRNet::AddResponderReply
+//
+// A responder is told apart by its address. One that is new is kept with
+// the flow that got to it, unless the TTL already has MDA_MAX_RESPONDERS.
+//*****************************************************************************
+void WinMTRNet::AddResponderReply(int at, const s_probe_reply& reply, const s_probe* entry)
+{
+	s_mdahop& hop = mda[at];
+	if(entry->discovery) {
+		--hop.pending;
+		++hop.answered;
+	}
+	int count = responders[at];
+	int r = 0;
+	for(; r<count; ++r) {
+		const s_nethost& known = responder[at][r];
+		if(reply.addr.sin_family==AF_INET6 ?
+		   known.addr6.sin6_family==AF_INET6 && IN6_ARE_ADDR_EQUAL(&known.addr6.sin6_addr, &reply.addr6.sin6_addr) :
+		   known.addr.sin_family==AF_INET && known.addr.sin_addr.s_addr==reply.addr.sin_addr.s_addr)
+			break;
+	}
+	if(r == MDA_MAX_RESPONDERS)
+		return;
+	BeginHopWrite(at);
+	if(r == count) {
+		if(reply.addr.sin_family==AF_INET6) {
+			responder[at][r].addr6.sin6_family = AF_INET6;
+			responder[at][r].addr6.sin6_addr = reply.addr6.sin6_addr;
 		} else {
-			DWORD err=GetLastError();
-			wmtrnet->SetErrorName(current->ttl - 1, err);
-			switch(err) {
-			case IP_REQ_TIMED_OUT: break;
-			default:
-				Sleep((DWORD)(wmtrnet->wmtrdlg->interval * 1000));
-			}
+			responder[at][r].addr.sin_family = AF_INET;
+			responder[at][r].addr.sin_addr = reply.addr.sin_addr;
 		}
-	}//end loop
-	TRACE_MSG("Thread with TTL=" << (int)current->ttl << " stopped.");
-	delete p;
-	return 0;
+		responders[at] = count + 1;
+		hop.flow[r] = entry->flow;
+	}
+	RecordReply(responder[at][r], reply.rtt);
+	EndHopWrite(at);
+	if(r == count)
+		ResolveResponder(at, r);
+}
+
+// a lost probe in the flow of a known responder counts against it
+void WinMTRNet::AddResponderLoss(int at, const s_probe* entry)
+{
+	s_mdahop& hop = mda[at];
+	if(entry->discovery) {
+		--hop.pending;
+		return;
+	}
+	for(int r=0; r<responders[at]; ++r) {
+		if(hop.flow[r] != entry->flow)
+			continue;
+		BeginHopWrite(at);
+		RecordLoss(responder[at][r]);
+		EndHopWrite(at);
+		return;
+	}
+}
+
+void WinMTRNet::StopTrace()
+{
+	tracing = false;
 }
 
 sockaddr* WinMTRNet::GetAddr(int at)
@@ -307,128 +553,223 @@ sockaddr* WinMTRNet::GetAddr(int at)
 
 int WinMTRNet::GetName(int at, char* n)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	strcpy(n, host[at].name);
-	ReleaseMutex(ghMutex);
+	s_nethost hop;
+	ReadHop(at, &hop);
+	strcpy(n, hop.name);
 	return 0;
 }
 
 int WinMTRNet::GetBest(int at)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	int ret = host[at].best;
-	ReleaseMutex(ghMutex);
-	return ret;
+	s_nethost hop;
+	ReadHop(at, &hop);
+	return hop.best;
 }
 
 int WinMTRNet::GetWorst(int at)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	int ret = host[at].worst;
-	ReleaseMutex(ghMutex);
-	return ret;
+	s_nethost hop;
+	ReadHop(at, &hop);
+	return hop.worst;
 }
 
 int WinMTRNet::GetAvg(int at)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	int ret = host[at].returned == 0 ? 0 : host[at].total / host[at].returned;
-	ReleaseMutex(ghMutex);
-	return ret;
+	s_nethost hop;
+	ReadHop(at, &hop);
+	return hop.returned == 0 ? 0 : (int)(hop.total / hop.returned);
 }
 
 int WinMTRNet::GetPercent(int at)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	int ret = (host[at].xmit == 0) ? 0 : (100 - (100 * host[at].returned / host[at].xmit));
-	ReleaseMutex(ghMutex);
-	return ret;
+	s_nethost hop;
+	ReadHop(at, &hop);
+	return (hop.xmit == 0) ? 0 : (int)(100 - (100LL * hop.returned / hop.xmit));
 }
 
 int WinMTRNet::GetLast(int at)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	int ret = host[at].last;
-	ReleaseMutex(ghMutex);
-	return ret;
+	s_nethost hop;
+	ReadHop(at, &hop);
+	return hop.last;
 }
 
 int WinMTRNet::GetReturned(int at)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	int ret = host[at].returned;
-	ReleaseMutex(ghMutex);
-	return ret;
+	s_nethost hop;
+	ReadHop(at, &hop);
+	return hop.returned;
 }
 
 int WinMTRNet::GetXmit(int at)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	int ret = host[at].xmit;
-	ReleaseMutex(ghMutex);
-	return ret;
+	s_nethost hop;
+	ReadHop(at, &hop);
+	return hop.xmit;
 }
 
+//*****************************************************************************
+// WinMTRNet::GetMax
+//
+// reached is only changed by the probe loop when the destination answers,
+// or when a router answers at its TTL after the path got longer.
+//*****************************************************************************
 int WinMTRNet::GetMax()
 {
-	// @todo : improve this (last hop guess)
-	WaitForSingleObject(ghMutex, INFINITE);
-	int max=0;//first try to find target, if not found, find best guess (doesn't work actually :P)
-	if(host[0].addr6.sin6_family==AF_INET6) {
-		for(; max<MAX_HOPS && memcmp(&host[max++].addr6.sin6_addr,&last_remote_addr6,sizeof(in6_addr)););
-		if(max==MAX_HOPS) {
-			while(max>1 && !memcmp(&host[max-1].addr6.sin6_addr,&host[max-2].addr6.sin6_addr,sizeof(in6_addr)) && (host[max-1].addr6.sin6_addr.u.Word[0]|host[max-1].addr6.sin6_addr.u.Word[1]|host[max-1].addr6.sin6_addr.u.Word[2]|host[max-1].addr6.sin6_addr.u.Word[3]|host[max-1].addr6.sin6_addr.u.Word[4]|host[max-1].addr6.sin6_addr.u.Word[5]|host[max-1].addr6.sin6_addr.u.Word[6]|host[max-1].addr6.sin6_addr.u.Word[7])) --max;
-		}
-	} else {
-		for(; max<MAX_HOPS && host[max++].addr.sin_addr.s_addr!=last_remote_addr.s_addr;);
-		if(max==MAX_HOPS) {
-			while(max>1 && host[max-1].addr.sin_addr.s_addr==host[max-2].addr.sin_addr.s_addr && host[max-1].addr.sin_addr.s_addr) --max;
-		}
+	int ttl = reached.load(std::memory_order_relaxed);
+	return ttl ? ttl : MAX_HOPS;
+}
+
+//*****************************************************************************
+// WinMTRNet::Snapshot
+//
+// Copies every hop into the caller's buffer in a single pass. Each hop is
+// read once through its seqlock, so its counters always belong together.
+//*****************************************************************************
+void WinMTRNet::Snapshot(s_pathsnapshot* path)
+{
+	s_nethost hops[MAX_HOPS];
+	int count = GetMax();
+	for(int at=0; at<count; ++at) ReadHop(at, &hops[at]);
+	FillSnapshot(hops, count, path);
+}
+
+// a percentile is the middle of a histogram bucket, which can be outside the RTTs seen
+static int ClampRTT(int rtt, const s_nethost& hop)
+{
+	if(!hop.returned) return 0;
+	return rtt < hop.best ? hop.best : rtt > hop.worst ? hop.worst : rtt;
+}
+
+//*****************************************************************************
+// WinMTRNet::SnapshotResponders
+//
+// Like Snapshot(), for the responders of every hop in multipath mode. They
+// have no recent history, only the totals.
+//*****************************************************************************
+void WinMTRNet::SnapshotResponders(s_pathresponders* responders)
+{
+	s_nethost hops[MDA_MAX_RESPONDERS];
+	int count = GetMax();
+	for(int at=0; at<MAX_HOPS; ++at) {
+		responders->count[at] = at < count ? ReadResponders(at, hops) : 0;
+		for(int r=0; r<responders->count[at]; ++r)
+			FillHop(hops[r], responders->responder[at][r]);
 	}
-	ReleaseMutex(ghMutex);
-	return max;
 }
 
+void WinMTRNet::FillSnapshot(const s_nethost* hops, int count, s_pathsnapshot* path)
+{
+	path->count = count;
+	for(int at=0; at<count; ++at)
+		FillHop(hops[at], path->hop[at]);
+}
+
+void WinMTRNet::FillHop(const s_nethost& hop, s_hopsnapshot& out)
+{
+	out.addr6 = hop.addr6;
+	strcpy(out.name, hop.name);
+	out.xmit = hop.xmit;
+	out.returned = hop.returned;
+	out.percent = (hop.xmit == 0) ? 0 : (int)(100 - (100LL * hop.returned / hop.xmit));
+	out.best = hop.best;
+	out.avg = hop.returned == 0 ? 0 : (int)(hop.total / hop.returned);
+	out.worst = hop.worst;
+	out.last = hop.last;
+	out.stdev = RttStdDev(hop.stats, hop.returned);
+	out.p95 = ClampRTT(RttPercentile(hop.stats, hop.returned, 95), hop);
+	out.p99 = ClampRTT(RttPercentile(hop.stats, hop.returned, 99), hop);
+	out.jitter = RttJitter(hop.stats);
+	out.recentPercent = (hop.recentXmit == 0) ? 0 : 100 - 100 * hop.recentReturned / hop.recentXmit;
+	out.recentAvg = hop.recentReturned == 0 ? 0 : (int)(hop.recentTotal / hop.recentReturned);
+	out.recentJitter = hop.recentDeltas == 0 ? 0 : (int)(hop.recentDeltaTotal / hop.recentDeltas);
+}
+
+// the address of a hop is only ever set by the probe loop, so it can test it without the seqlock
 void WinMTRNet::SetAddr(int at, u_long addr)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
 	if(host[at].addr.sin_addr.s_addr==0) {
-		TRACE_MSG("Start DnsResolverThread for new address " << addr << ". Old addr value was " << host[at].addr.sin_addr.s_addr);
+		TRACE_MSG("Resolve new address " << addr << " at hop " << at);
+		BeginHopWrite(at);
 		host[at].addr.sin_family=AF_INET;
 		host[at].addr.sin_addr.s_addr=addr;
-		dns_resolver_thread* dnt=new dns_resolver_thread;
-		dnt->index=at;
-		dnt->winmtr=this;
-		if(wmtrdlg->useDNS) _beginthread(DnsResolverThread, 0, dnt);
-		else DnsResolverThread(dnt);
+		EndHopWrite(at);
+		ResolveHop(at);
 	}
-	ReleaseMutex(ghMutex);
 }
 
-void WinMTRNet::SetAddr6(int at, IPV6_ADDRESS_EX addrex)
+void WinMTRNet::SetAddr6(int at, const in6_addr& addr)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	if(!(host[at].addr6.sin6_addr.u.Word[0]|host[at].addr6.sin6_addr.u.Word[1]|host[at].addr6.sin6_addr.u.Word[2]|host[at].addr6.sin6_addr.u.Word[3]|host[at].addr6.sin6_addr.u.Word[4]|host[at].addr6.sin6_addr.u.Word[5]|host[at].addr6.sin6_addr.u.Word[6]|host[at].addr6.sin6_addr.u.Word[7])) {
-		TRACE_MSG("Start DnsResolverThread for new address " << addrex.sin6_addr[0] << ". Old addr value was " << host[at].addr6.sin6_addr.u.Word[0]);
+	if(IN6_IS_ADDR_UNSPECIFIED(&host[at].addr6.sin6_addr)) {
+		TRACE_MSG("Resolve new IPv6 address at hop " << at);
+		BeginHopWrite(at);
 		host[at].addr6.sin6_family=AF_INET6;
-		host[at].addr6.sin6_addr=*(in6_addr*)&addrex.sin6_addr;
-		dns_resolver_thread* dnt=new dns_resolver_thread;
-		dnt->index=at;
-		dnt->winmtr=this;
-		if(wmtrdlg->useDNS) _beginthread(DnsResolverThread,0,dnt);
-		else DnsResolverThread(dnt);
+		host[at].addr6.sin6_addr=addr;
+		EndHopWrite(at);
+		ResolveHop(at);
 	}
-	ReleaseMutex(ghMutex);
 }
 
-void WinMTRNet::SetName(int at, char* n)
+//*****************************************************************************
+// WinMTRNet::ResolveHop
+//
+// Shows the address of a new hop until its name is known. A cached name is
+// set right away, otherwise OnResolved() sets it from a resolver thread.
+//*****************************************************************************
+void WinMTRNet::ResolveHop(int at)
+{
+	char name[NI_MAXHOST];
+	if(!getnameinfo((sockaddr*)&host[at].addr6,sizeof(sockaddr_in6),name,NI_MAXHOST,NULL,0,NI_NUMERICHOST))
+		SetName(at, name);
+	if(useDNS && WinMTRResolver::Shared().Resolve((sockaddr*)&host[at].addr6, name, OnResolved, this, at) && *name)
+		SetName(at, name);
+}
+
+// the same for a responder in multipath mode, its index for the resolver is after those of the hops
+void WinMTRNet::ResolveResponder(int at, int r)
+{
+	char name[NI_MAXHOST];
+	int index = MaxHost + at * MDA_MAX_RESPONDERS + r;
+	if(!getnameinfo((sockaddr*)&responder[at][r].addr6,sizeof(sockaddr_in6),name,NI_MAXHOST,NULL,0,NI_NUMERICHOST))
+		SetResponderName(at, r, name);
+	if(useDNS && WinMTRResolver::Shared().Resolve((sockaddr*)&responder[at][r].addr6, name, OnResolved, this, index) && *name)
+		SetResponderName(at, r, name);
+}
+
+void WinMTRNet::OnResolved(void* owner, int index, const char* name)
+{
+	if(!*name)
+		return;
+	if(index < MaxHost)
+		((WinMTRNet*)owner)->SetName(index, name);
+	else
+		((WinMTRNet*)owner)->SetResponderName((index - MaxHost) / MDA_MAX_RESPONDERS, (index - MaxHost) % MDA_MAX_RESPONDERS, name);
+}
+
+void WinMTRNet::SetName(int at, const char* n)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
+	BeginHopWrite(at);
 	strcpy(host[at].name, n);
-	ReleaseMutex(ghMutex);
+	EndHopWrite(at);
+}
+
+void WinMTRNet::SetResponderName(int at, int r, const char* n)
+{
+	BeginHopWrite(at);
+	strcpy(responder[at][r].name, n);
+	EndHopWrite(at);
 }
 
 void WinMTRNet::SetErrorName(int at, DWORD errnum)
+{
+	const char* name = ErrorName(errnum);
+	BeginHopWrite(at);
+	if(!*host[at].name)
+		strcpy(host[at].name,name);
+	EndHopWrite(at);
+}
+
+const char* WinMTRNet::ErrorName(DWORD errnum)
 {
 	const char* name;
 	switch(errnum) {
@@ -472,65 +813,82 @@ void WinMTRNet::SetErrorName(int at, DWORD errnum)
 		TRACE_MSG("==UNKNOWN ERROR== " << errnum);
 		name="Unknown error! (please report)"; break;
 	}
-	WaitForSingleObject(ghMutex, INFINITE);
-	if(!*host[at].name)
-		strcpy(host[at].name,name);
-	ReleaseMutex(ghMutex);
+	return name;
+}
+
+// counts a probe and its reply in one write, so readers never see it as lost in between
+void WinMTRNet::AddReply(int at, int rtt, ULONGLONG sent)
+{
+	BeginHopWrite(at);
+	RecordReply(host[at], rtt);
+	RecordRecent(recent[at], host[at], sent, rtt);
+	EndHopWrite(at);
 }
 
-void WinMTRNet::UpdateRTT(int at, int rtt)
+void WinMTRNet::RecordReply(s_nethost& hop, int rtt)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	host[at].last=rtt;
-	host[at].total+=rtt;
-	if(host[at].best>rtt || host[at].xmit==1)
-		host[at].best=rtt;
-	if(host[at].worst<rtt)
-		host[at].worst=rtt;
-	ReleaseMutex(ghMutex);
+	++hop.xmit;
+	++hop.returned;
+	RttStatsAdd(hop.stats, rtt, hop.returned > 1 ? hop.last : -1, hop.returned);
+	hop.last=rtt;
+	hop.total+=rtt;
+	if(hop.best>rtt || hop.returned==1)
+		hop.best=rtt;
+	if(hop.worst<rtt)
+		hop.worst=rtt;
 }
 
-void WinMTRNet::AddReturned(int at)
+void WinMTRNet::RecordLoss(s_nethost& hop)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	++host[at].returned;
-	ReleaseMutex(ghMutex);
+	++hop.xmit;
 }
 
-void WinMTRNet::AddXmit(int at)
+void WinMTRNet::AddXmit(int at, ULONGLONG sent)
 {
-	WaitForSingleObject(ghMutex, INFINITE);
-	++host[at].xmit;
-	ReleaseMutex(ghMutex);
+	BeginHopWrite(at);
+	RecordLoss(host[at]);
+	RecordRecent(recent[at], host[at], sent, -1);
+	EndHopWrite(at);
 }
 
-void DnsResolverThread(void* p)
+//*****************************************************************************
+// WinMTRNet::RecordRecent
+//
+// Puts the outcome of a probe into the history of its hop and keeps the sums
+// of the hop over the history up to date, the probe it replaces is taken out
+// of them again. The jitter is the mean difference between the RTTs of
+// consecutive replies.
+//*****************************************************************************
+void WinMTRNet::RecordRecent(s_pinghistory& history, s_nethost& hop, ULONGLONG sent, int rtt)
 {
-	dns_resolver_thread* dnt=(dns_resolver_thread*)p;
-	WinMTRNet* wn=dnt->winmtr;
-	char hostname[NI_MAXHOST];
-	if(!getnameinfo(wn->GetAddr(dnt->index),sizeof(sockaddr_in6),hostname,NI_MAXHOST,NULL,0,NI_NUMERICHOST)) {
-		wn->SetName(dnt->index,hostname);
+	s_pingsample& ping = history.ping[history.next];
+	if(history.count == SAVED_PINGS) {
+		--hop.recentXmit;
+		if(ping.rtt >= 0) {
+			--hop.recentReturned;
+			hop.recentTotal -= ping.rtt;
+		}
+		if(ping.delta >= 0) {
+			--hop.recentDeltas;
+			hop.recentDeltaTotal -= ping.delta;
+		}
+	} else {
+		++history.count;
 	}
-	if(wn->wmtrdlg->useDNS) {
-		TRACE_MSG("DNS resolver thread started.");
-		if(!getnameinfo(wn->GetAddr(dnt->index),sizeof(sockaddr_in6),hostname,NI_MAXHOST,NULL,0,0)) {
-			wn->SetName(dnt->index,hostname);
+	ping.sent = sent;
+	ping.rtt = rtt;
+	ping.delta = -1;
+	++hop.recentXmit;
+	if(rtt >= 0) {
+		++hop.recentReturned;
+		hop.recentTotal += rtt;
+		if(history.lastRtt >= 0) {
+			ping.delta = rtt > history.lastRtt ? rtt - history.lastRtt : history.lastRtt - rtt;
+			++hop.recentDeltas;
+			hop.recentDeltaTotal += ping.delta;
 		}
-		TRACE_MSG("DNS resolver thread stopped.");
+		history.lastRtt = rtt;
 	}
-	delete p;
+	if(++history.next == SAVED_PINGS)
+		history.next = 0;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -13,17 +13,17 @@
 #ifndef WINMTRNET_H_
 #define WINMTRNET_H_
 
+#include "WinMTRProbe.h"
+#include "WinMTRTimerWheel.h"
+#include "WinMTRStats.h"
+#include <atomic>
+#include <string>
 
-class WinMTRDialog;
-
-typedef IP_OPTION_INFORMATION IPINFO, *PIPINFO, FAR* LPIPINFO;
-#ifdef _WIN64
-typedef ICMP_ECHO_REPLY32 ICMPECHO, *PICMPECHO, FAR* LPICMPECHO;
-#else
-typedef ICMP_ECHO_REPLY ICMPECHO, *PICMPECHO, FAR* LPICMPECHO;
-#endif // _WIN64
-
-#define ECHO_REPLY_TIMEOUT 5000
+#define MAX_HOPS 30
+#define TRACE_SLOTS 16384	// most probes in flight, enough for every TTL at MIN_INTERVAL (MDA_MIN_INTERVAL in multipath mode) until ECHO_REPLY_TIMEOUT
+#define MDA_MIN_INTERVAL 0.04	// seconds, shortest multipath interval whose MDA_BURST probes per TTL fit in TRACE_SLOTS
+#define MDA_MAX_RESPONDERS 16	// per TTL in multipath mode
+#define MDA_BURST 4			// new flows a TTL has in flight while its responders aren't all known
 
 struct s_nethost {
 	union {
@@ -32,11 +32,86 @@ struct s_nethost {
 	};
 	int xmit;			// number of PING packets sent
 	int returned;		// number of ICMP echo replies received
-	unsigned long total;	// total time
-	int last;				// last time
-	int best;				// best time
-	int worst;			// worst time
+	ULONGLONG total;	// total time, us
+	int last;				// last time, us
+	int best;				// best time, us
+	int worst;			// worst time, us
+	s_rttstats stats;	// percentiles, variance and jitter of the replies
+	int recentXmit;		// probes of the last SAVED_PINGS
+	int recentReturned;
+	ULONGLONG recentTotal;	// us, of the recent replies
+	int recentDeltas;	// recent replies with one before them
+	ULONGLONG recentDeltaTotal;	// us, their RTT differences to the reply before
+	char name[255];
+};
+
+// outcome of one probe in the recent history of a hop
+struct s_pingsample {
+	ULONGLONG	sent;		// ms, on the clock of the probe loop
+	int			rtt;		// us, -1 = lost
+	int			delta;		// us, difference to the RTT of the reply before, -1 if none
+};
+
+// the last SAVED_PINGS probes of a hop, oldest first from next once full
+struct s_pinghistory {
+	s_pingsample	ping[SAVED_PINGS];
+	int				next;
+	int				count;
+	int				lastRtt;	// us, of the newest reply, -1 if none
+};
+
+// statistics of one hop as copied by WinMTRNet::Snapshot()
+struct s_hopsnapshot {
+	union {
+		sockaddr_in addr;
+		sockaddr_in6 addr6;
+	};
 	char name[255];
+	int xmit;
+	int returned;
+	int percent;			// packet loss
+	int best;				// times in us
+	int avg;
+	int worst;
+	int last;
+	int stdev;
+	int p95;				// percentiles
+	int p99;
+	int jitter;
+	int recentPercent;		// loss, average and jitter of the last SAVED_PINGS probes
+	int recentAvg;
+	int recentJitter;
+};
+
+// the whole path, filled in one pass so every consumer works on the same data
+struct s_pathsnapshot {
+	int count;				// number of hops, as returned by GetMax()
+	struct s_hopsnapshot hop[MAX_HOPS];
+};
+
+// the responders of every hop in multipath mode, as copied by WinMTRNet::SnapshotResponders()
+struct s_pathresponders {
+	int count[MAX_HOPS];
+	struct s_hopsnapshot responder[MAX_HOPS][MDA_MAX_RESPONDERS];
+};
+
+// one outstanding echo request; the probe table is indexed by seq % WinMTRNet::slots
+struct s_probe {
+	unsigned short	seq;		// sequence number of this probe
+	int				ttl;		// TTL the probe was sent with, 0 = free slot
+	ULONGLONG		sent;		// GetTickCount64() at send time
+	s_timer			timeout;	// ECHO_REPLY_TIMEOUT after sent
+	int				flow;		// multipath: the flow it was sent in
+	bool			discovery;	// multipath: a new flow, looking for more responders
+};
+
+// multipath discovery of one TTL, only used by the probe loop
+struct s_mdahop {
+	int		next;		// next new flow
+	int		answered;	// new flows that got an address back
+	int		pending;	// new flows in flight
+	int		flow[MDA_MAX_RESPONDERS];	// a flow that got to each responder
+	int		turn;		// responder probed next once they are all known
 };
 
 //*****************************************************************************
@@ -47,65 +122,106 @@ struct s_nethost {
 
 class WinMTRNet
 {
-	typedef FARPROC PIO_APC_ROUTINE;//not the best way to do it, but works ;) (we do not use it anyway)
-	//IPv4
-	typedef HANDLE(WINAPI* LPFNICMPCREATEFILE)(VOID);
-	typedef BOOL (WINAPI* LPFNICMPCLOSEHANDLE)(HANDLE);
-	typedef DWORD (WINAPI* LPFNICMPSENDECHO2)(HANDLE IcmpHandle,HANDLE Event,PIO_APC_ROUTINE ApcRoutine,PVOID ApcContext,in_addr DestinationAddress,LPVOID RequestData,WORD RequestSize,PIP_OPTION_INFORMATION RequestOptions,LPVOID ReplyBuffer,DWORD ReplySize,DWORD Timeout);
-	//IPv6
-	typedef HANDLE(WINAPI* LPFNICMP6CREATEFILE)(VOID);
-	typedef BOOL (WINAPI* LPFNICMP6CLOSEHANDLE)(HANDLE);
-	typedef DWORD (WINAPI* LPFNICMP6SENDECHO2)(HANDLE IcmpHandle,HANDLE Event,PIO_APC_ROUTINE ApcRoutine,PVOID ApcContext,sockaddr_in6* SourceAddress,sockaddr_in6* DestinationAddress,LPVOID RequestData,WORD RequestSize,PIP_OPTION_INFORMATION RequestOptions,LPVOID ReplyBuffer,DWORD ReplySize,DWORD Timeout);
-	
 public:
 
-	WinMTRNet(WinMTRDialog* wp);
+	WinMTRNet();
 	~WinMTRNet();
 	void	DoTrace(sockaddr* sockaddr);
 	void	ResetHops();
 	void	StopTrace();
-	
+	// PROBE_ICMP, PROBE_UDP or PROBE_TCP to port, returns false if this
+	// platform can't send them
+	bool	SetProbeType(int type, WORD port = TCP_DEFAULT_PORT);
+	// keeps every probe in flow (0..65535) of per-flow load balancers, so all
+	// hops are on one path; PROBE_FLOW_ANY to let it vary. Returns false if
+	// the probe type can't
+	bool	SetFlow(int flow);
+	// multipath mode, after SetProbeType(): probes of new flows find the
+	// responders of every TTL until there are no more with this confidence
+	// (0..1), then each of them is probed in turn; 0 = off. Returns false if
+	// the probe type can't vary the flow, which only ICMP can
+	bool	SetMultipath(double confidence);
+
 	sockaddr* GetAddr(int at);
 	int		GetName(int at, char* n);
-	int		GetBest(int at);
+	int		GetBest(int at);		// times in us
 	int		GetWorst(int at);
 	int		GetAvg(int at);
 	int		GetPercent(int at);
 	int		GetLast(int at);
 	int		GetReturned(int at);
 	int		GetXmit(int at);
-	int		GetMax();
-	
+	int		GetMax();				// hops up to the destination, MAX_HOPS until it answered
+	void	Snapshot(s_pathsnapshot* path);
+	void	SnapshotResponders(s_pathresponders* responders);
+
 	void	SetAddr(int at, u_long addr);
-	void	SetAddr6(int at, IPV6_ADDRESS_EX addrex);
-	void	SetName(int at, char* n);
+	void	SetAddr6(int at, const in6_addr& addr);
+	void	SetName(int at, const char* n);
 	void	SetErrorName(int at,DWORD errnum);
-	void	UpdateRTT(int at, int rtt);
-	void	AddReturned(int at);
-	void	AddXmit(int at);
-	
-	WinMTRDialog*		wmtrdlg;
-	union {
-		in_addr last_remote_addr;
-		in6_addr last_remote_addr6;
-	};
+
+	// statistics of a hop table without the seqlock, for WinMTRMonitor
+	static void	RecordReply(s_nethost& hop, int rtt);
+	static void	RecordLoss(s_nethost& hop);
+	static void	FillSnapshot(const s_nethost* hops, int count, s_pathsnapshot* path);
+	static void	FillHop(const s_nethost& hop, s_hopsnapshot& out);
+	static const char* ErrorName(DWORD errnum);	// text shown for a failed probe
+	void	AddXmit(int at, ULONGLONG sent);
+
+	// trace settings, copied from the dialog before DoTrace()
+	WORD				pingsize;
+	double				interval;
+	BOOL				useDNS;
+	int					count;			// probes per hop before DoTrace returns by itself, 0 = until StopTrace()
+
 	bool				hasIPv6;
 	bool				tracing;
 	bool				initialized;
-	HANDLE				hICMP;
-	HANDLE				hICMP6;
-	//IPv4
-	LPFNICMPCREATEFILE lpfnIcmpCreateFile;
-	LPFNICMPCLOSEHANDLE lpfnIcmpCloseHandle;
-	LPFNICMPSENDECHO2 lpfnIcmpSendEcho2;
-	//IPv6
-	LPFNICMP6CREATEFILE lpfnIcmp6CreateFile;
-	LPFNICMP6SENDECHO2 lpfnIcmp6SendEcho2;
+	std::string			error;			// why the backend didn't come up, for the caller to show
 private:
-	HINSTANCE			hICMP_DLL;
-	
+	bool	SendProbe(WinMTRProbe* prober, int ttl, sockaddr* sockaddr, const char* data, WORD size, ULONGLONG now, int flow = PROBE_FLOW_ANY, bool discovery = false);
+	void	SendMultipath(WinMTRProbe* prober, int at, sockaddr* sockaddr, const char* data, WORD size, ULONGLONG now);
+	void	OnProbeReply(const s_probe_reply& reply);
+	void	AddResponderReply(int at, const s_probe_reply& reply, const s_probe* entry);
+	void	AddResponderLoss(int at, const s_probe* entry);
+	void	ResolveHop(int at);
+	void	ResolveResponder(int at, int r);
+	void	SetResponderName(int at, int r, const char* n);
+	static void	OnResolved(void* owner, int index, const char* name);
+	void	ExpireProbe(s_probe* entry);
+	int		TraceSlots();
+	double	TraceInterval();
+	void	AddReply(int at, int rtt, ULONGLONG sent);
+	static void	RecordRecent(s_pinghistory& history, s_nethost& hop, ULONGLONG sent, int rtt);
+	void	BeginHopWrite(int at);
+	void	EndHopWrite(int at);
+	void	ReadHop(int at, s_nethost* hop);
+	int		ReadResponders(int at, s_nethost* hops);
+
+	WinMTRProbe*		prober;
+	WinMTRProbe*		prober6;
+	int					flow;			// of SetFlow(), kept by SetProbeType()
+	int					probeType;		// of SetProbeType()
+	WORD				probePort;
+	int					slots;			// probe table entries in use and size of the backends, see TraceSlots()
+
 	struct s_nethost	host[MaxHost];
-	HANDLE				ghMutex;
+	std::atomic<unsigned>	hostSeq[MaxHost];	// per-hop seqlock, odd while host[] is being written
+	struct s_pinghistory	recent[MAX_HOPS];	// only used by the probe loop, the sums are in host[]
+	std::atomic<int>	reached;		// lowest TTL the destination answered at, 0 = not yet
+
+	// multipath mode, the responders under the seqlock of their hop
+	bool				multipath;
+	int					mdaStop[MDA_MAX_RESPONDERS + 1];	// answered new flows after which k responders are all there are
+	struct s_nethost	responder[MAX_HOPS][MDA_MAX_RESPONDERS];
+	int					responders[MAX_HOPS];
+	struct s_mdahop		mda[MAX_HOPS];
+
+	struct s_probe		probes[TRACE_SLOTS];
+	unsigned short		nextSeq;
+	int					inflight;		// probes sent and not yet completed
+	WinMTRTimerWheel	wheel;			// probe timeouts and the next probe of every TTL
+	s_timer				sendTimer[MAX_HOPS];
 };
 
 #endif	// ifndef WINMTRNET_H_
@@ -51,7 +51,7 @@ BOOL WinMTROptions::OnInitDialog()
 	
 	char strtmp[20];
 	
-	sprintf(strtmp, "%.1f", interval);
+	sprintf(strtmp, "%g", interval);
 	m_editInterval.SetWindowText(strtmp);
 	
 	sprintf(strtmp, "%d", pingsize);
@@ -80,6 +80,7 @@ void WinMTROptions::OnOK()
 
 	m_editInterval.GetWindowText(tmpstr, 20);
 	interval = atof(tmpstr);
+	if(interval < MIN_INTERVAL) interval = MIN_INTERVAL;
 
 	m_editSize.GetWindowText(tmpstr, 20);
 	pingsize = atoi(tmpstr);
@@ -0,0 +1,523 @@
+//*****************************************************************************
+// FILE:            WinMTRPlot.cpp
+//
+// DESCRIPTION:     Implementation of the graph layout and drawing
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRPlot.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Define color palette for different hops (visually distinct colors)
+const unsigned int WinMTRPlot::HopColors[MAX_GRAPH_HOPS] = {
+    CANVAS_RGB(0, 114, 189),      // Blue
+    CANVAS_RGB(217, 83, 25),      // Orange
+    CANVAS_RGB(237, 177, 32),     // Yellow
+    CANVAS_RGB(126, 47, 142),     // Purple
+    CANVAS_RGB(119, 172, 48),     // Green
+    CANVAS_RGB(162, 20, 47),      // Dark Red
+    CANVAS_RGB(77, 190, 238),     // Cyan
+    CANVAS_RGB(0, 158, 115),      // Teal
+    CANVAS_RGB(204, 121, 167),    // Pink
+    CANVAS_RGB(230, 159, 0),      // Gold
+    CANVAS_RGB(86, 180, 233),     // Sky Blue
+    CANVAS_RGB(213, 94, 0),       // Vermillion
+    CANVAS_RGB(0, 0, 128),        // Navy
+    CANVAS_RGB(128, 0, 128),      // Magenta
+    CANVAS_RGB(128, 128, 0),      // Olive
+    CANVAS_RGB(0, 128, 128),      // Teal Dark
+    CANVAS_RGB(255, 0, 255),      // Fuchsia
+    CANVAS_RGB(0, 255, 255),      // Aqua
+    CANVAS_RGB(192, 192, 192),    // Silver
+    CANVAS_RGB(128, 0, 0),        // Maroon
+    CANVAS_RGB(0, 128, 0),        // Dark Green
+    CANVAS_RGB(0, 0, 255),        // Pure Blue
+    CANVAS_RGB(255, 0, 0),        // Red
+    CANVAS_RGB(255, 165, 0),      // Orange Bright
+    CANVAS_RGB(75, 0, 130),       // Indigo
+    CANVAS_RGB(238, 130, 238),    // Violet
+    CANVAS_RGB(165, 42, 42),      // Brown
+    CANVAS_RGB(244, 164, 96),     // Sandy Brown
+    CANVAS_RGB(46, 139, 87),      // Sea Green
+    CANVAS_RGB(218, 112, 214)     // Orchid
+};
+
+WinMTRPlot::WinMTRPlot()
+    : m_window(m_history)
+{
+    m_autoScale = true;
+    SetMaxRTT(500);  // Default max RTT in ms
+    m_selectedHop = -1;  // Show all hops by default
+    m_maxSamples = MAX_GRAPH_SAMPLES;  // Default to 5 minutes
+    m_viewTier = -1;
+    m_viewStart = 0;
+    m_viewStartTime = 0;
+    m_viewSpan = 0;
+
+    m_width = m_height = 0;
+    memset(&m_graphRect, 0, sizeof(m_graphRect));
+    m_pixelScale = 0;
+    m_viewOrigin = 0;
+    m_gridMaxRTT = m_dataMaxRTT = m_maxRTT;
+    m_maxValidHops = 0;
+    for (int i = 0; i < MAX_GRAPH_HOPS; i++) m_hopPosition[i] = -1;
+    m_currentVisibleHops = 0;  // Will be updated during layout
+    m_legendCount = 0;
+    m_legendVisibleHops = 0;
+}
+
+void WinMTRPlot::AddSample(ULONGLONG timestamp, const int* rttValues, const char* const* hostnames, int numHops)
+{
+    // The history keeps 24 hours, the time span only selects how much is drawn
+    if (m_history.Size() == m_history.Capacity()) m_window.DropOldest();
+    m_history.Add(timestamp, rttValues, hostnames, numHops);
+    m_window.Update(ViewStart());
+}
+
+void WinMTRPlot::Clear()
+{
+    m_history.Clear();
+    m_window.Clear();
+}
+
+bool WinMTRPlot::SetTimeResolution(int maxSamples)
+{
+    if (maxSamples <= 0 || maxSamples > MAX_HISTORY_SAMPLES) return false;  // Max 24 hours at 1/sec
+    m_maxSamples = maxSamples;
+    return true;
+}
+
+void WinMTRPlot::Draw(WinMTRCanvas& canvas, int width, int height)
+{
+    Layout(width, height);
+    DrawStatic(canvas);
+    if (!Empty()) DrawData(canvas, 0);
+}
+
+//*****************************************************************************
+// WinMTRPlot::Layout
+//
+// Everything the static part and the lines are drawn from: the graph area,
+// the time span, the hops drawn and their colors, the Y scales and the
+// legend items.
+//*****************************************************************************
+void WinMTRPlot::Layout(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+
+    // Calculate graph area (leave space for legend on right only when showing multiple hops)
+    // When a single hop is selected, use full width. Otherwise, reserve space for legend.
+    if (m_selectedHop < 0) {
+        // Space for wider legend with hostnames, and margins
+        m_graphRect.left = 40;
+        m_graphRect.top = 30;
+        m_graphRect.right = width - 260 - 10;
+        m_graphRect.bottom = height - 40;
+    } else {
+        // Single hop selected - use full width, margins on all sides
+        m_graphRect.left = 40;
+        m_graphRect.top = 30;
+        m_graphRect.right = width - 40;
+        m_graphRect.bottom = height - 40;
+    }
+
+    UpdateView();
+
+    // Hops drawn have a response and a valid hostname (not 100% loss) in the
+    // span. Colors are spread over their count for maximum contrast.
+    m_maxValidHops = m_window.MaxValidHops();
+    m_currentVisibleHops = 0;
+    for (int i = 0; i < MAX_GRAPH_HOPS; i++) {
+        m_hopPosition[i] = -1;  // Not visible
+        if (i < m_maxValidHops && m_window.HasData(i) && m_window.HasHostname(i)) {
+            m_hopPosition[i] = m_currentVisibleHops++;
+        }
+    }
+
+    // The Y axis labels scale to all hops, the lines only to the hops drawn
+    m_gridMaxRTT = m_maxRTT;
+    m_dataMaxRTT = m_maxRTT;
+    if (m_autoScale) {
+        int gridMax = 0, dataMax = 0;
+        for (int i = 0; i < MAX_GRAPH_HOPS; i++) {
+            int rtt = m_window.MaxRtt(i);
+            if (rtt > gridMax) gridMax = rtt;
+            if (m_hopPosition[i] >= 0 && (m_selectedHop < 0 || m_selectedHop == i) && rtt > dataMax) dataMax = rtt;
+        }
+        m_gridMaxRTT = (int)(gridMax * 1.1);  // Add 10% margin
+        if (m_gridMaxRTT < PLOT_MIN_RTT) m_gridMaxRTT = PLOT_MIN_RTT;
+        m_dataMaxRTT = (int)(dataMax * 1.1);
+        if (m_dataMaxRTT < PLOT_MIN_RTT) m_dataMaxRTT = PLOT_MIN_RTT;
+    }
+
+    // Legend items are the hops with a response whose newest one has a hostname
+    m_legendCount = 0;
+    m_legendVisibleHops = 0;
+    for (int i = 0; i < m_maxValidHops; i++) {
+        if (!m_window.HasData(i) || m_window.LatestHostname(i)[0] == '\0') continue;
+        if (m_legendCount < MAX_LEGEND_ITEMS) m_legendHops[m_legendCount++] = i;
+        m_legendVisibleHops++;
+    }
+
+    // Pixel position of the span start in whole pixels, so that the lines
+    // only ever move by whole pixels as the span scrolls
+    double graphWidth = m_graphRect.Width();
+    if (m_viewTier < 0) {
+        m_pixelScale = m_maxSamples > 1 ? graphWidth / (m_maxSamples - 1) : graphWidth;
+        m_viewOrigin = floor((double)m_history.Serial(m_viewStart) * m_pixelScale);
+    } else {
+        m_pixelScale = graphWidth / (double)m_viewSpan;
+        m_viewOrigin = floor((double)m_viewStartTime * m_pixelScale);
+    }
+}
+
+//*****************************************************************************
+// WinMTRPlot::UpdateView
+//
+// Pick the data the time span is drawn from. Spans of more than a second per
+// pixel use the coarsest rollup tier that still has a bucket per pixel and
+// keeps the whole span, shorter ones the raw samples.
+//*****************************************************************************
+void WinMTRPlot::UpdateView()
+{
+    m_viewSpan = (ULONGLONG)m_maxSamples * 1000;
+    ULONGLONG msPerPixel = m_graphRect.Width() > 0 ? m_viewSpan / m_graphRect.Width() : m_viewSpan;
+
+    m_viewTier = -1;
+    for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+        if (m_history.TierPeriod(tier) <= msPerPixel) m_viewTier = tier;
+    }
+    while (m_viewTier >= 0 && m_viewTier < HISTORY_TIERS - 1 && m_history.TierSpan(m_viewTier) < m_viewSpan) {
+        m_viewTier++;
+    }
+
+    m_viewStart = ViewStart();
+    m_window.Update(m_viewStart);
+}
+
+// First raw sample of the time span. Drawn from raw samples the span is
+// m_maxSamples samples, drawn from a tier it is the same number of seconds.
+int WinMTRPlot::ViewStart()
+{
+    if (m_viewTier < 0 || m_history.Size() == 0) return WindowStart();
+
+    ULONGLONG end = m_history.Timestamp(m_history.Size() - 1);
+    m_viewStartTime = end > m_viewSpan ? end - m_viewSpan : 0;
+    return m_history.FindSample(m_viewStartTime);
+}
+
+// First rollup bucket of the time span that the tier still keeps
+ULONGLONG WinMTRPlot::ViewFirstBucket()
+{
+    ULONGLONG first = m_viewStartTime / m_history.TierPeriod(m_viewTier);
+    if (first < m_history.FirstBucket(m_viewTier)) first = m_history.FirstBucket(m_viewTier);
+    return first;
+}
+
+// X of a raw sample by serial number
+float WinMTRPlot::SampleX(ULONGLONG serial)
+{
+    return (float)(m_graphRect.left + (double)serial * m_pixelScale - m_viewOrigin);
+}
+
+// X of a rollup bucket of the view tier, buckets starting before the span at its start
+float WinMTRPlot::BucketX(ULONGLONG bucket)
+{
+    ULONGLONG t = bucket * m_history.TierPeriod(m_viewTier);
+    if (t < m_viewStartTime) t = m_viewStartTime;
+    return (float)(m_graphRect.left + (double)t * m_pixelScale - m_viewOrigin);
+}
+
+ULONGLONG WinMTRPlot::LastDrawn() const
+{
+    if (m_viewTier < 0) return m_history.Serial(m_history.Size() - 1);
+    return m_history.LastBucket(m_viewTier);
+}
+
+float WinMTRPlot::LastDrawnX(ULONGLONG last)
+{
+    return m_viewTier < 0 ? SampleX(last) : BucketX(last);
+}
+
+// FNV-1a, for telling whether a layer shows the same as last time
+static unsigned int HashBytes(unsigned int hash, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+unsigned int WinMTRPlot::StaticKey()
+{
+    int values[6] = { m_width, m_height, !Empty(), m_gridMaxRTT, m_selectedHop, m_legendVisibleHops };
+    unsigned int key = HashBytes(2166136261u, values, sizeof(values));
+    key = HashBytes(key, m_legendHops, m_legendCount * sizeof(m_legendHops[0]));
+    for (int i = 0; i < m_legendCount; i++) {
+        const char* name = m_window.LatestHostname(m_legendHops[i]);
+        key = HashBytes(key, name, strlen(name) + 1);
+    }
+    return key;
+}
+
+unsigned int WinMTRPlot::DataKey()
+{
+    int values[6] = { m_width, m_height, m_dataMaxRTT, m_viewTier, m_maxSamples, m_selectedHop };
+    unsigned int key = HashBytes(2166136261u, values, sizeof(values));
+    key = HashBytes(key, &m_currentVisibleHops, sizeof(m_currentVisibleHops));
+    return HashBytes(key, m_hopPosition, sizeof(m_hopPosition));
+}
+
+void WinMTRPlot::DrawStatic(WinMTRCanvas& canvas)
+{
+    // Fill background
+    canvas.FillRect(0, 0, m_width, m_height, PLOT_BACKGROUND);  // Dark background
+
+    if (Empty()) {
+        // Draw "No Data" message
+        canvas.DrawString("No Data - Start Tracing", 0, 0, (float)m_width, (float)m_height, 16,
+                          CANVAS_ALIGN_CENTER, CANVAS_ALIGN_CENTER, CANVAS_RGB(128, 128, 128));
+        return;
+    }
+
+    DrawGrid(canvas);
+
+    // Only draw legend when showing all hops
+    if (m_selectedHop < 0) {
+        DrawLegend(canvas);
+    }
+}
+
+void WinMTRPlot::DrawGrid(WinMTRCanvas& canvas)
+{
+    const s_plotrect& graphRect = m_graphRect;
+    const unsigned int gridColor = CANVAS_RGB(64, 64, 64);
+    const unsigned int axisColor = CANVAS_RGB(128, 128, 128);
+    const unsigned int textColor = CANVAS_RGB(200, 200, 200);
+
+    // Max RTT for Y-axis
+    int maxRTT = m_gridMaxRTT;
+
+    // Draw vertical grid lines (time)
+    int numVLines = 10;
+    for (int i = 0; i <= numVLines; i++) {
+        int x = graphRect.left + (graphRect.Width() * i / numVLines);
+        canvas.DrawLine((float)x, (float)graphRect.top, (float)x, (float)graphRect.bottom, 1, gridColor);
+    }
+
+    // Draw horizontal grid lines (RTT)
+    int numHLines = 10;
+    for (int i = 0; i <= numHLines; i++) {
+        int y = graphRect.bottom - (graphRect.Height() * i / numHLines);
+        canvas.DrawLine((float)graphRect.left, (float)y, (float)graphRect.right, (float)y, 1, gridColor);
+
+        // Draw Y-axis labels
+        char label[32];
+        sprintf(label, "%g ms", (double)(maxRTT * i / numHLines) * HISTORY_RTT_UNIT / 1000);
+        canvas.DrawString(label, (float)(graphRect.left - 35), (float)(y - 8), 30, 16, 9,
+                          CANVAS_ALIGN_FAR, CANVAS_ALIGN_NEAR, textColor);
+    }
+
+    // Draw axes
+    canvas.DrawLine((float)graphRect.left, (float)graphRect.bottom, (float)graphRect.right, (float)graphRect.bottom, 2, axisColor);  // X-axis
+    canvas.DrawLine((float)graphRect.left, (float)graphRect.top, (float)graphRect.left, (float)graphRect.bottom, 2, axisColor);      // Y-axis
+
+    // Draw X-axis label
+    canvas.DrawString("Time (samples)", (float)graphRect.left, (float)(graphRect.bottom + 10), (float)graphRect.Width(), 20, 9,
+                      CANVAS_ALIGN_CENTER, CANVAS_ALIGN_NEAR, textColor);
+
+    // Draw Y-axis label (rotated)
+    canvas.DrawStringUp("RTT (ms)", (float)(graphRect.left - 35), (float)(graphRect.top + graphRect.Height() / 2), 9, textColor);
+}
+
+//*****************************************************************************
+// WinMTRPlot::DrawData
+//
+// Drawing starts with the samples three columns left of fromX so that the
+// lines entering the columns drawn are complete.
+//*****************************************************************************
+void WinMTRPlot::DrawData(WinMTRCanvas& canvas, int fromX)
+{
+    const s_plotrect& graphRect = m_graphRect;
+    int windowStart = m_viewStart;
+    int windowEnd = m_history.Size();
+    if (windowEnd - windowStart < 2) return;
+
+    int maxRTT = m_dataMaxRTT;
+
+    int clipLeft = fromX > graphRect.left - 2 ? fromX : graphRect.left - 2;
+    canvas.SetClip(clipLeft, graphRect.top - 2, graphRect.right + 2 - clipLeft, graphRect.Height() + 4);
+
+    ULONGLONG firstBucket = m_viewTier < 0 ? 0 : ViewFirstBucket();
+    if (fromX > graphRect.left) {
+        double first = (fromX - 3 - graphRect.left + m_viewOrigin) / m_pixelScale;
+        if (first > 0 && m_viewTier < 0) {
+            ULONGLONG serial = (ULONGLONG)ceil(first);
+            if (serial > m_history.Serial(windowStart)) {
+                windowStart = serial < m_history.Serial(windowEnd) ? m_history.IndexOf(serial) : windowEnd;
+            }
+        } else if (first > 0) {
+            ULONGLONG bucket = (ULONGLONG)first / m_history.TierPeriod(m_viewTier);
+            if (bucket > firstBucket) firstBucket = bucket;
+        }
+    }
+
+    std::vector<s_canvaspoint> points;
+    points.reserve(2 * (graphRect.Width() + 1));
+
+    // Draw lines for each hop
+    for (int hop = 0; hop < m_maxValidHops; hop++) {
+        // Skip hops without data or without valid hostname (100% packet loss)
+        if (m_hopPosition[hop] < 0) continue;
+
+        // Skip if a specific hop is selected and this isn't it
+        if (m_selectedHop >= 0 && m_selectedHop != hop) continue;
+
+        // Get color using position mapping for maximum contrast
+        unsigned int lineColor = GetHopColorByPosition(m_hopPosition[hop], m_currentVisibleHops);
+
+        // Decimate to the minimum and maximum of each pixel column, kept in
+        // sample order. Spikes survive and the number of points drawn
+        // depends on the graph width instead of the time span.
+        int column = -1;
+        int colMin = 0, colMax = 0;
+        float xMin = 0, xMax = 0;
+
+        auto addCanvasPoint = [&](float x, int rtt) {
+            s_canvaspoint point = { x, RttToY(rtt, maxRTT) };
+            points.push_back(point);
+        };
+        auto flushColumn = [&]() {
+            if (column < 0) return;
+            if (xMin <= xMax) {
+                addCanvasPoint(xMin, colMin);
+                if (xMax != xMin || colMax != colMin) addCanvasPoint(xMax, colMax);
+            } else {
+                addCanvasPoint(xMax, colMax);
+                addCanvasPoint(xMin, colMin);
+            }
+            column = -1;
+        };
+        auto addPoint = [&](float x, int lo, int hi) {
+            if ((int)x != column) {
+                flushColumn();
+                column = (int)x;
+                colMin = lo; xMin = x;
+                colMax = hi; xMax = x;
+                return;
+            }
+            if (lo < colMin) { colMin = lo; xMin = x; }
+            if (hi > colMax) { colMax = hi; xMax = x; }
+        };
+        auto breakLine = [&]() {
+            // Break in data - draw what we have and start new segment
+            flushColumn();
+            if (points.size() > 1) {
+                canvas.DrawLines(&points[0], (int)points.size(), 2.0f, lineColor);
+            }
+            points.clear();
+        };
+
+        if (m_viewTier < 0) {
+            for (int i = windowStart; i < windowEnd; i++) {
+                int rtt = hop < m_history.ValidHops(i) ? m_history.Rtt(hop, i) : -1;
+                if (rtt >= 0) {
+                    addPoint(SampleX(m_history.Serial(i)), rtt, rtt);
+                } else {
+                    breakLine();
+                }
+            }
+        } else {
+            // Long time spans draw the min/max envelope of the rollup buckets
+            for (ULONGLONG b = firstBucket; b <= m_history.LastBucket(m_viewTier); b++) {
+                const s_rollup& r = m_history.Rollup(m_viewTier, hop, b);
+                if (r.replies) {
+                    addPoint(BucketX(b), r.min, r.max);
+                } else {
+                    breakLine();
+                }
+            }
+        }
+        breakLine();
+    }
+
+    canvas.ResetClip();
+}
+
+float WinMTRPlot::RttToY(int rtt, int maxRTT)
+{
+    float y = m_graphRect.bottom - (m_graphRect.Height() * (float)rtt / (float)maxRTT);
+
+    // Clamp Y to graph bounds
+    if (y < m_graphRect.top) y = (float)m_graphRect.top;
+    if (y > m_graphRect.bottom) y = (float)m_graphRect.bottom;
+    return y;
+}
+
+void WinMTRPlot::DrawLegend(WinMTRCanvas& canvas)
+{
+    if (Empty()) return;
+
+    const unsigned int textColor = CANVAS_RGB(200, 200, 200);
+
+    int legendX = m_width - 250;  // Wider legend for hostnames
+    int legendY = 40;
+    int lineHeight = 18;
+
+    // Draw legend title
+    canvas.DrawString("Active Hops", (float)legendX, (float)(legendY - 20), 240, 16, 8,
+                      CANVAS_ALIGN_NEAR, CANVAS_ALIGN_NEAR, textColor);
+
+    // Draw legend items (only for hops with data and valid hostnames)
+    for (int item = 0; item < m_legendCount; item++) {
+        int y = legendY + item * lineHeight;
+
+        // Get color using position mapping for maximum contrast
+        unsigned int lineColor = GetHopColorByPosition(item, m_legendVisibleHops);
+        canvas.DrawLine((float)legendX, (float)(y + 6), (float)(legendX + 20), (float)(y + 6), 3.0f, lineColor);
+
+        // Draw hostname
+        canvas.DrawString(m_window.LatestHostname(m_legendHops[item]), (float)(legendX + 25), (float)y, 220, 16, 8,
+                          CANVAS_ALIGN_NEAR, CANVAS_ALIGN_NEAR, textColor);
+    }
+
+    if (m_legendCount == 0) {
+        // No hops with data yet
+        canvas.DrawString("Waiting for responses...", (float)legendX, (float)legendY, 240, 16, 8,
+                          CANVAS_ALIGN_NEAR, CANVAS_ALIGN_NEAR, textColor);
+    }
+}
+
+int WinMTRPlot::GetColorIndexForHop(int hopPosition, int totalVisibleHops)
+{
+    // For maximum contrast, space colors evenly across the palette
+    // based on the number of visible hops
+    if (totalVisibleHops <= 1) {
+        return 0;  // Just use the first color
+    }
+
+    // Calculate the spacing to maximize color contrast
+    // We have MAX_GRAPH_HOPS colors in our palette
+    int spacing = MAX_GRAPH_HOPS / totalVisibleHops;
+    int colorIndex = (hopPosition * spacing) % MAX_GRAPH_HOPS;
+
+    return colorIndex;
+}
+
+unsigned int WinMTRPlot::GetHopColorByPosition(int hopPosition, int totalVisibleHops)
+{
+    if (hopPosition >= 0 && totalVisibleHops > 0) {
+        int colorIndex = GetColorIndexForHop(hopPosition, totalVisibleHops);
+        if (colorIndex >= 0 && colorIndex < MAX_GRAPH_HOPS) {
+            return HopColors[colorIndex];
+        }
+    }
+    return HopColors[0];  // Default to first color
+}
@@ -0,0 +1,125 @@
+//*****************************************************************************
+// FILE:            WinMTRPlot.h
+//
+// DESCRIPTION:     RTT history, layout and drawing of the graph onto any
+//                  WinMTRCanvas. Independent of the window showing it, so the
+//                  same graph renders into an image without a display.
+//
+//*****************************************************************************
+
+#ifndef WINMTRPLOT_H_
+#define WINMTRPLOT_H_
+
+#include "WinMTRHistory.h"
+#include "WinMTRCanvas.h"
+
+#define MAX_GRAPH_SAMPLES 300  // 5 minutes at 1 sample/second
+#define MAX_LEGEND_ITEMS 20
+#define PLOT_MIN_RTT (1000 / HISTORY_RTT_UNIT)  // lowest top of an auto-scaled Y axis, 1 ms
+#define PLOT_BACKGROUND CANVAS_RGB(32, 32, 32)
+
+struct s_plotrect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    int Width() const { return right - left; }
+    int Height() const { return bottom - top; }
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRPlot
+//
+// Layout() works out what a canvas of the given size shows, the Draw
+// functions then draw it. The static part (background, grid, labels and
+// legend) and the lines can be drawn separately, for a caller that keeps
+// them in layers; StaticKey() and DataKey() tell when a layer is out of date.
+//*****************************************************************************
+class WinMTRPlot
+{
+public:
+    WinMTRPlot();
+
+    // Add a new RTT sample in us for all hops with hostnames
+    void AddSample(ULONGLONG timestamp, const int* rttValues, const char* const* hostnames, int numHops);
+    void Clear();
+    bool Empty() const { return m_history.Size() == 0; }
+    int Size() const { return m_history.Size(); }
+
+    void SetAutoScale(bool autoScale) { m_autoScale = autoScale; }
+    // ms, the scale drawn with is in HISTORY_RTT_UNIT like the history
+    void SetMaxRTT(int maxRTT) { m_maxRTT = maxRTT * (1000 / HISTORY_RTT_UNIT); }
+    // -1 for all hops
+    void SetSelectedHop(int hopIndex) { m_selectedHop = hopIndex; }
+    // Number of samples, or seconds, the time span shows
+    bool SetTimeResolution(int maxSamples);
+
+    void Layout(int width, int height);
+    // Layout and draw everything
+    void Draw(WinMTRCanvas& canvas, int width, int height);
+    void DrawStatic(WinMTRCanvas& canvas);
+    // Lines from pixel column fromX to the right edge, 0 draws all of them
+    void DrawData(WinMTRCanvas& canvas, int fromX);
+
+    // Hashes of what the static part and the lines show, of the last Layout()
+    unsigned int StaticKey();
+    unsigned int DataKey();
+    const s_plotrect& GraphRect() const { return m_graphRect; }
+    // Whole pixel position of the span start, lines drawn at one origin are
+    // shifted by the difference at another
+    double Origin() const { return m_viewOrigin; }
+    // Newest sample serial or bucket the lines end with, and its X
+    ULONGLONG LastDrawn() const;
+    float LastDrawnX(ULONGLONG last);
+
+private:
+    void DrawGrid(WinMTRCanvas& canvas);
+    void DrawLegend(WinMTRCanvas& canvas);
+    float RttToY(int rtt, int maxRTT);
+    void UpdateView();
+    int ViewStart();
+    ULONGLONG ViewFirstBucket();
+    float SampleX(ULONGLONG serial);
+    float BucketX(ULONGLONG bucket);
+
+    unsigned int GetHopColorByPosition(int hopPosition, int totalVisibleHops);
+    int GetColorIndexForHop(int hopPosition, int totalVisibleHops);
+
+    // First sample of the displayed time span
+    int WindowStart() const { return m_history.Size() > m_maxSamples ? m_history.Size() - m_maxSamples : 0; }
+
+    WinMTRHistory m_history;
+    WinMTRHistoryWindow m_window;   // aggregates over the samples of the view
+
+    bool m_autoScale;
+    int m_maxRTT;
+    int m_selectedHop;  // -1 = show all, >= 0 = show only selected hop
+    int m_maxSamples;   // Maximum samples to display (time resolution)
+
+    // What the current layout shows, set by UpdateView()
+    int m_viewTier;             // rollup tier the lines are drawn from, -1 = raw samples
+    int m_viewStart;            // first raw sample of the time span
+    ULONGLONG m_viewStartTime;  // start of the time span when drawing from a tier
+    ULONGLONG m_viewSpan;       // length of the time span in ms
+
+    // Set by Layout()
+    int m_width;
+    int m_height;
+    s_plotrect m_graphRect;
+    double m_pixelScale;        // pixels per sample, or per ms when drawing from a tier
+    double m_viewOrigin;        // whole pixel position of the span start
+    int m_gridMaxRTT;           // top of the Y axis labels
+    int m_dataMaxRTT;           // top of the lines
+    int m_maxValidHops;
+    int m_hopPosition[MAX_GRAPH_HOPS];      // color position of the hops drawn, -1 = not drawn
+    int m_currentVisibleHops;   // Number of currently visible hops (for color spacing)
+    int m_legendHops[MAX_LEGEND_ITEMS];
+    int m_legendCount;
+    int m_legendVisibleHops;    // hops the legend colors are spread over
+
+    // Colors for different hops (up to 30)
+    static const unsigned int HopColors[MAX_GRAPH_HOPS];
+};
+
+#endif // WINMTRPLOT_H_
@@ -0,0 +1,79 @@
+//*****************************************************************************
+// FILE:            WinMTRProbe.h
+//
+//
+// DESCRIPTION:
+//   Probe backend interface of WinMTRNet. A backend sends echo requests, UDP
+//   datagrams or TCP SYNs with a given TTL and reports the replies it matched
+//   back by sequence number.
+//
+// NOTES:
+//   WinMTRProbeWin.cpp  - Iphlpapi.dll (IcmpSendEcho2/Icmp6SendEcho2), echo
+//                         requests only
+//   WinMTRProbeLinux.cpp - unprivileged ICMP and UDP datagram sockets, TCP
+//                         connects
+//
+//*****************************************************************************
+
+#ifndef WINMTRPROBE_H_
+#define WINMTRPROBE_H_
+
+#include <string>
+
+#define ECHO_REPLY_TIMEOUT 5000
+#define MAX_INFLIGHT 1024	// default size of the probe tables, must be a power of two
+
+// probe types of WinMTRProbe::Create()
+#define PROBE_ICMP		0	// echo requests, the destination sends an echo reply
+#define PROBE_UDP		1	// datagrams to UDP_BASE_PORT and up, it sends a port unreachable
+#define PROBE_TCP		2	// SYNs to one port, it sends a SYN-ACK or a RST
+#define UDP_BASE_PORT	33434
+#define TCP_DEFAULT_PORT	80
+#define PROBE_FLOW_ANY	-1	// WinMTRProbe::SetFlow(), the flow may change from probe to probe
+
+struct s_probe_reply {
+	unsigned short	seq;		// sequence number of the probe this reply belongs to
+	DWORD			status;		// IP_SUCCESS, IP_TTL_EXPIRED_TRANSIT or an IP_* error
+	DWORD			rtt;		// round trip time in us
+	union {						// responding host
+		sockaddr_in addr;
+		sockaddr_in6 addr6;
+	};
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRProbe
+//
+//
+//*****************************************************************************
+
+class WinMTRProbe
+{
+public:
+	virtual ~WinMTRProbe() {}
+
+	// returns the backend of this platform for AF_INET or AF_INET6, NULL if unavailable
+	// with the reason in error; slots is the number of probes it can have in flight, a
+	// power of two up to 65536; port is the destination port of PROBE_TCP
+	static WinMTRProbe* Create(int family, int slots = MAX_INFLIGHT, int type = PROBE_ICMP, WORD port = TCP_DEFAULT_PORT, std::string* error = NULL);
+	// waits up to timeout ms until any of the backends has replies to fetch with Wait()
+	static void		WaitAny(WinMTRProbe** probes, int count, DWORD timeout);
+
+	// sends one probe, or queues it until Flush(); returns IP_SUCCESS or the
+	// IP_* error of a failed send, a queued probe that fails comes back from
+	// Wait() with the error
+	virtual DWORD	Send(unsigned short seq, int ttl, const sockaddr* dest, const char* data, WORD size) = 0;
+	// sends the probes queued by Send()
+	virtual void	Flush() {}
+	// keeps the probes sent after it in flow 0..65535 of per-flow load
+	// balancers, which hash the ports or the ICMP checksum and identifier;
+	// returns false if the backend can't
+	virtual bool	SetFlow(int flow) { return flow == PROBE_FLOW_ANY; }
+	// the number of probes it can have in flight, at most the slots of Create(),
+	// a power of two; Send() refuses a seq whose slot is still in use
+	virtual int		GetSlots() = 0;
+	// waits up to timeout ms for replies, returns the number stored in replies
+	virtual int		Wait(DWORD timeout, s_probe_reply* replies, int count) = 0;
+};
+
+#endif	// ifndef WINMTRPROBE_H_
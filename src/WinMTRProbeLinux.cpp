@@ -0,0 +1,897 @@
+//*****************************************************************************
+// FILE:            WinMTRProbeLinux.cpp
+//
+//
+// DESCRIPTION:
+//   Probe backend for Linux on unprivileged ICMP datagram sockets
+//   (SOCK_DGRAM/IPPROTO_ICMP and IPPROTO_ICMPV6), UDP sockets or TCP
+//   connects. The TTL is set per probe, echo replies are read from the socket
+//   and TTL exceeded or unreachable messages from its error queue
+//   (IP_RECVERR/IPV6_RECVERR).
+//   Round trip times are taken from the kernel receive timestamps of the
+//   replies (SO_TIMESTAMPNS), so they don't include the time until the probe
+//   loop gets to read them.
+//
+// NOTES:
+//   The user's group has to be allowed by net.ipv4.ping_group_range, root is
+//   not needed. The kernel owns the ICMP identifier, so replies are matched by
+//   sequence number only.
+//
+//   Routers may quote no more than the UDP header of a datagram, so a UDP
+//   probe is told apart by its destination port alone: probe slot i goes to
+//   UDP_BASE_PORT + i, there are at most UDP_PORTS of them in flight. UDP
+//   probes are queued by Send() and go out in one sendmmsg() per Flush(),
+//   each with its TTL as ancillary data; the errors are read with recvmmsg().
+//
+//   A TCP probe is a non-blocking connect() on a socket of its own, so the
+//   kernel matches the SYN-ACK, RST or ICMP error to it by the sequence
+//   number and ports of the SYN. The sockets are watched by an epoll
+//   instance, which is the descriptor polled by Wait(); a probe costs one
+//   descriptor until its answer or ECHO_REPLY_TIMEOUT.
+//
+//   SetFlow() keeps the fields per-flow load balancers hash constant, as
+//   Paris traceroute does. The kernel keeps the ICMP identifier of a socket,
+//   the first two bytes of the echo data make up for the sequence number in
+//   the checksum. UDP and TCP probes have no flow: UDP probes are told apart
+//   by their ports, and the one other field of a flow's probes that differs,
+//   the UDP checksum, isn't passed on with an error by IP_RECVERR. TCP
+//   probes can't share their ports.
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRProbe.h"
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <fcntl.h>
+#include <netinet/udp.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <deque>
+#include <linux/errqueue.h>
+#include <time.h>
+#include <vector>
+
+#define ICMP4_ECHO_REQUEST		8
+#define ICMP4_ECHO_REPLY		0
+#define ICMP4_DEST_UNREACH		3
+#define ICMP4_TIME_EXCEEDED		11
+#define ICMP6_DEST_UNREACH		1
+#define ICMP6_PACKET_TOO_BIG	2
+#define ICMP6_TIME_EXCEEDED		3
+#define ICMP6_ECHO_REQUEST		128
+#define ICMP6_ECHO_REPLY		129
+
+#define UDP_PORTS				16384	// destination ports of UDP probes, a power of two
+#define SEND_BATCH				1024	// queued UDP probes per sendmmsg(), at most UIO_MAXIOV
+#define RECEIVE_BATCH			64		// errors per recvmmsg()
+#define ERROR_DATA				64		// bytes of the probe read with an error
+
+// when a probe was sent, on both clocks since the kernel stamps replies with the realtime clock
+struct s_sendtime {
+	ULONGLONG	monotonic;	// us, GetTimeMicros()
+	ULONGLONG	realtime;	// us, CLOCK_REALTIME
+	unsigned short	seq;	// UDP: probe sent to the port of this slot
+	bool		inflight;	// UDP: no error for it yet
+};
+
+// a UDP probe waiting for Flush()
+struct s_udpprobe {
+	unsigned short	seq;
+	int				ttl;
+	sockaddr_in6	dest;		// with the port of the probe
+	size_t			offset;		// of its data in WinMTRProbeLinux::payload
+	WORD			size;
+};
+
+// the socket of a TCP probe
+struct s_tcpprobe {
+	int				fd;			// -1 = none
+	sockaddr_in6	dest;
+};
+
+struct s_icmp_echo {
+	uint8_t		type;
+	uint8_t		code;
+	uint16_t	checksum;	// filled in by the kernel
+	uint16_t	id;			// replaced by the kernel
+	uint16_t	seq;
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRProbeLinux
+//
+//
+//*****************************************************************************
+
+class WinMTRProbeLinux : public WinMTRProbe
+{
+public:
+	WinMTRProbeLinux(int family, int slots, int type, WORD port);
+	~WinMTRProbeLinux();
+
+	bool	Init(std::string& error);
+	DWORD	Send(unsigned short seq, int ttl, const sockaddr* dest, const char* data, WORD size);
+	void	Flush();
+	bool	SetFlow(int flow);
+	int		GetSlots();
+	int		Wait(DWORD timeout, s_probe_reply* replies, int count);
+
+private:
+	DWORD	SendUdp(unsigned short seq, int ttl, const sockaddr* dest, const char* data, WORD size);
+	DWORD	SendTcp(unsigned short seq, int ttl, const sockaddr* dest);
+	void	Fail(unsigned short seq, DWORD status);
+	int		WaitTcp(DWORD timeout, s_probe_reply* replies, int count);
+	bool	ReceiveTcp(int slot, s_probe_reply& reply);
+	void	ExpireTcp();
+	void	CloseTcp(int slot);
+	int		MatchUdp(const sockaddr_in6& peer);
+	bool	ReceiveReply(s_probe_reply& reply);
+	int		ReceiveErrors(s_probe_reply* replies, int count);
+	bool	ParseError(msghdr* msg, size_t len, const char* data, const sockaddr_in6& target, s_probe_reply& reply);
+	DWORD	GetStatus(const sock_extended_err* ee);
+	DWORD	GetRTT(unsigned short seq, ULONGLONG received);
+	static DWORD	SendError(int err);
+	static ULONGLONG	GetRealtimeMicros();
+	static ULONGLONG	GetReceiveTime(msghdr* msg);
+
+	int						family;
+	int						type;		// PROBE_ICMP, PROBE_UDP or PROBE_TCP
+	WORD					port;		// of PROBE_TCP
+	int						flow;		// of SetFlow()
+	int						sock;		// TCP: the epoll instance
+	std::vector<s_sendtime>	sent;		// send time per seq & (slots - 1), UDP: per port
+	std::vector<char>		packet;
+	std::vector<s_udpprobe>	queue;		// UDP probes until Flush()
+	std::vector<char>		payload;
+	std::vector<mmsghdr>	msgs;		// of the sendmmsg() in Flush()
+	std::vector<iovec>		iovs;
+	std::vector<char>		controls;
+	std::vector<s_probe_reply>	completed;	// known before Wait(), see Fail()
+	std::vector<s_tcpprobe>	conns;		// TCP: per seq & (slots - 1)
+	std::deque<unsigned short>	opened;	// TCP: seqs of the connects, oldest first
+
+	friend class WinMTRProbe;
+};
+
+//*****************************************************************************
+// WinMTRProbe::Create
+//
+//
+//*****************************************************************************
+WinMTRProbe* WinMTRProbe::Create(int family, int slots, int type, WORD port, std::string* error)
+{
+	WinMTRProbeLinux* probe = new WinMTRProbeLinux(family, slots, type, port);
+	std::string reason;
+	if(!probe->Init(reason)) {
+		if(error) *error = reason;
+		delete probe;
+		return NULL;
+	}
+	return probe;
+}
+
+WinMTRProbeLinux::WinMTRProbeLinux(int family, int slots, int type, WORD port)
+	: family(family), type(type), port(port), flow(PROBE_FLOW_ANY), sock(-1), sent(type == PROBE_UDP && slots > UDP_PORTS ? UDP_PORTS : slots)
+{
+	if(type == PROBE_TCP) {
+		s_tcpprobe none;
+		memset(&none, 0, sizeof(none));
+		none.fd = -1;
+		conns.resize(slots, none);
+	}
+}
+
+WinMTRProbeLinux::~WinMTRProbeLinux()
+{
+	for(size_t i=0; i<conns.size(); ++i)
+		if(conns[i].fd >= 0) close(conns[i].fd);
+	if(sock >= 0) close(sock);
+}
+
+// the text of errno after what
+static std::string SystemError(const char* what)
+{
+	return std::string(what) + ": " + strerror(errno);
+}
+
+bool WinMTRProbeLinux::Init(std::string& error)
+{
+	if(type == PROBE_TCP) {
+		sock = epoll_create1(EPOLL_CLOEXEC);
+		if(sock < 0) {
+			error = SystemError("Unable to create epoll instance");
+			return false;
+		}
+		// a descriptor per probe in flight
+		rlimit files;
+		if(!getrlimit(RLIMIT_NOFILE, &files) && files.rlim_cur < files.rlim_max) {
+			files.rlim_cur = files.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &files);
+		}
+		return true;
+	}
+	if(type == PROBE_UDP) {
+		sock = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+		if(sock < 0) {
+			error = SystemError("Unable to open UDP socket");
+			return false;
+		}
+	} else {
+		sock = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, family==AF_INET6 ? (int)IPPROTO_ICMPV6 : (int)IPPROTO_ICMP);
+		if(sock < 0) {
+			bool denied = errno == EACCES;
+			error = SystemError(family==AF_INET6 ? "Unable to open ICMPv6 socket" : "Unable to open ICMP socket");
+			if(denied)
+				error += " (check net.ipv4.ping_group_range)";
+			return false;
+		}
+	}
+	int on = 1;
+	int pmtudisc;// don't fragment, like IPFLAG_DONT_FRAGMENT on Windows
+	setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));// without it the RTT is measured when a reply is read
+	if(sent.size() > MAX_INFLIGHT) {
+		// room for a reply to every probe in flight, as far as net.core.rmem_max allows
+		int rcvbuf = (int)sent.size() * 256;
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	}
+	if(family==AF_INET6) {
+		pmtudisc = IPV6_PMTUDISC_DO;
+		if(setsockopt(sock, SOL_IPV6, IPV6_RECVERR, &on, sizeof(on)) ||
+		   setsockopt(sock, SOL_IPV6, IPV6_MTU_DISCOVER, &pmtudisc, sizeof(pmtudisc))) {
+			error = SystemError("Unable to set up IPv6 socket");
+			return false;
+		}
+	} else {
+		pmtudisc = IP_PMTUDISC_DO;
+		if(setsockopt(sock, SOL_IP, IP_RECVERR, &on, sizeof(on)) ||
+		   setsockopt(sock, SOL_IP, IP_MTU_DISCOVER, &pmtudisc, sizeof(pmtudisc))) {
+			error = SystemError("Unable to set up IPv4 socket");
+			return false;
+		}
+	}
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::Send
+//
+//
+//*****************************************************************************
+DWORD WinMTRProbeLinux::Send(unsigned short seq, int ttl, const sockaddr* dest, const char* data, WORD size)
+{
+	if(type == PROBE_UDP)
+		return SendUdp(seq, ttl, dest, data, size);
+	if(type == PROBE_TCP)
+		return SendTcp(seq, ttl, dest);
+	packet.resize(sizeof(s_icmp_echo) + (flow >= 0 && size < 2 ? 2 : size));
+	s_icmp_echo* icmp = (s_icmp_echo*)&packet[0];
+	icmp->type = family==AF_INET6 ? ICMP6_ECHO_REQUEST : ICMP4_ECHO_REQUEST;
+	icmp->code = 0;
+	icmp->checksum = 0;
+	icmp->id = 0;
+	icmp->seq = htons(seq);
+	memcpy(&packet[sizeof(s_icmp_echo)], data, size);
+	if(flow >= 0) {
+		// seq + this word is flow in one's complement, so is the checksum the same
+		DWORD sum = (DWORD)flow + (0xFFFF - seq);
+		WORD word = htons((WORD)((sum & 0xFFFF) + (sum >> 16)));
+		memcpy(&packet[sizeof(s_icmp_echo)], &word, sizeof(word));
+	}
+
+	int r = family==AF_INET6 ?
+			setsockopt(sock, SOL_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl)) :
+			setsockopt(sock, SOL_IP, IP_TTL, &ttl, sizeof(ttl));
+	if(r) return IP_BAD_OPTION;
+
+	s_sendtime& when = sent[seq & (sent.size() - 1)];
+	when.realtime = GetRealtimeMicros();
+	when.monotonic = GetTimeMicros();
+	socklen_t destlen = family==AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+	for(int retry = 0; ; ++retry) {
+		if(sendto(sock, &packet[0], packet.size(), 0, dest, destlen) >= 0)
+			return IP_SUCCESS;
+		DWORD status = SendError(errno);
+		// pending ICMP error of an earlier probe, it is in the error queue as well
+		if((status != IP_DEST_NET_UNREACHABLE && status != IP_DEST_HOST_UNREACHABLE) || retry)
+			return status;
+	}
+}
+
+// the IP_* status of a failed send
+DWORD WinMTRProbeLinux::SendError(int err)
+{
+	switch(err) {
+	case ENETUNREACH:
+		return IP_DEST_NET_UNREACHABLE;
+	case EHOSTUNREACH:
+	case ECONNREFUSED:
+	case EPROTO:
+		return IP_DEST_HOST_UNREACHABLE;
+	case EMSGSIZE:
+		return IP_PACKET_TOO_BIG;
+	case EAGAIN:
+	case ENOBUFS:
+	case ENOMEM:
+		return IP_NO_RESOURCES;
+	default:
+		return IP_GENERAL_FAILURE;
+	}
+}
+
+// ICMP probes only, see the notes at the top
+bool WinMTRProbeLinux::SetFlow(int flow)
+{
+	if(type != PROBE_ICMP && flow != PROBE_FLOW_ANY)
+		return false;
+	this->flow = flow;
+	return true;
+}
+
+// UDP probes have no more than UDP_PORTS ports
+int WinMTRProbeLinux::GetSlots()
+{
+	return (int)sent.size();
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::SendUdp
+//
+// Queues the probe for Flush(). The port of its slot is refused while the
+// probe sent to it before can still be answered.
+//*****************************************************************************
+DWORD WinMTRProbeLinux::SendUdp(unsigned short seq, int ttl, const sockaddr* dest, const char* data, WORD size)
+{
+	int slot = seq & (sent.size() - 1);
+	s_sendtime& when = sent[slot];
+	if(when.inflight && GetTimeMicros() - when.monotonic < (ULONGLONG)ECHO_REPLY_TIMEOUT * 1000)
+		return IP_NO_RESOURCES;
+	if(queue.size() == SEND_BATCH)
+		Flush();
+	when.seq = seq;
+	when.inflight = true;
+	when.monotonic = GetTimeMicros();// until Flush() sets the real one
+
+	s_udpprobe probe;
+	probe.seq = seq;
+	probe.ttl = ttl;
+	memset(&probe.dest, 0, sizeof(probe.dest));
+	memcpy(&probe.dest, dest, family==AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+	probe.dest.sin6_port = htons((unsigned short)(UDP_BASE_PORT + slot));// same place in sockaddr_in
+	probe.offset = payload.size();
+	probe.size = size;
+	payload.insert(payload.end(), data, data + size);
+	queue.push_back(probe);
+	return IP_SUCCESS;
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::Flush
+//
+// Sends the queued UDP probes with sendmmsg(). It stops at the first
+// message that fails, which is reported through Wait() and skipped.
+//*****************************************************************************
+void WinMTRProbeLinux::Flush()
+{
+	size_t n = queue.size();
+	if(!n)
+		return;
+	size_t space = CMSG_SPACE(sizeof(int));
+	msgs.resize(n);
+	iovs.resize(n);
+	controls.assign(n * space, 0);
+	for(size_t i=0; i<n; ++i) {
+		const s_udpprobe& probe = queue[i];
+		iovs[i].iov_base = probe.size ? &payload[probe.offset] : NULL;
+		iovs[i].iov_len = probe.size;
+		msghdr& msg = msgs[i].msg_hdr;
+		memset(&msgs[i], 0, sizeof(mmsghdr));
+		msg.msg_name = (void*)&probe.dest;
+		msg.msg_namelen = family==AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+		msg.msg_iov = &iovs[i];
+		msg.msg_iovlen = 1;
+		msg.msg_control = &controls[i * space];
+		msg.msg_controllen = space;
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = family==AF_INET6 ? SOL_IPV6 : SOL_IP;
+		cmsg->cmsg_type = family==AF_INET6 ? IPV6_HOPLIMIT : IP_TTL;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &probe.ttl, sizeof(int));
+	}
+
+	ULONGLONG realtime = GetRealtimeMicros();
+	ULONGLONG monotonic = GetTimeMicros();
+	for(size_t i=0; i<n; ++i) {
+		s_sendtime& when = sent[queue[i].seq & (sent.size() - 1)];
+		when.realtime = realtime;
+		when.monotonic = monotonic;
+	}
+	size_t done = 0;
+	bool retry = false;
+	while(done < n) {
+		int r = sendmmsg(sock, &msgs[done], (unsigned)(n - done), 0);
+		if(r > 0) {
+			done += r;
+			retry = false;
+			continue;
+		}
+		if(r < 0 && errno == EINTR)
+			continue;
+		DWORD status = r < 0 ? SendError(errno) : IP_GENERAL_FAILURE;
+		// pending ICMP error of an earlier probe, it is in the error queue as well
+		if((status == IP_DEST_NET_UNREACHABLE || status == IP_DEST_HOST_UNREACHABLE) && !retry) {
+			retry = true;
+			continue;
+		}
+		Fail(queue[done++].seq, status);
+		retry = false;
+	}
+	queue.clear();
+	payload.clear();
+}
+
+void WinMTRProbeLinux::Fail(unsigned short seq, DWORD status)
+{
+	sent[seq & (sent.size() - 1)].inflight = false;
+	s_probe_reply reply;
+	memset(&reply, 0, sizeof(reply));
+	reply.seq = seq;
+	reply.status = status;
+	completed.push_back(reply);
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::SendTcp
+//
+// Starts a connect() to port of dest with the TTL of the probe. A loopback
+// destination may answer before connect() returns.
+//*****************************************************************************
+DWORD WinMTRProbeLinux::SendTcp(unsigned short seq, int ttl, const sockaddr* dest)
+{
+	int slot = seq & (conns.size() - 1);
+	CloseTcp(slot);
+	int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+	if(fd < 0)
+		return errno == EMFILE || errno == ENFILE ? IP_NO_RESOURCES : SendError(errno);
+	int on = 1;
+	int syns = 1;// the fewest, the SYN is still sent again once after the initial RTO of 1 s
+	linger reset = {1, 0};// closed with a RST, no FIN_WAIT or TIME_WAIT left behind
+	setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+	setsockopt(fd, IPPROTO_TCP, TCP_SYNCNT, &syns, sizeof(syns));
+	setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+	int r = family==AF_INET6 ?
+			setsockopt(fd, SOL_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl)) || setsockopt(fd, SOL_IPV6, IPV6_RECVERR, &on, sizeof(on)) :
+			setsockopt(fd, SOL_IP, IP_TTL, &ttl, sizeof(ttl)) || setsockopt(fd, SOL_IP, IP_RECVERR, &on, sizeof(on));
+	epoll_event event;
+	event.events = EPOLLOUT;
+	event.data.u32 = slot;
+	if(r || epoll_ctl(sock, EPOLL_CTL_ADD, fd, &event)) {
+		close(fd);
+		return r ? IP_BAD_OPTION : IP_NO_RESOURCES;
+	}
+	s_tcpprobe& conn = conns[slot];
+	conn.fd = fd;
+	memset(&conn.dest, 0, sizeof(conn.dest));
+	memcpy(&conn.dest, dest, family==AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+	conn.dest.sin6_port = htons(port);// same place in sockaddr_in
+
+	s_sendtime& when = sent[slot];
+	when.seq = seq;
+	when.realtime = GetRealtimeMicros();
+	when.monotonic = GetTimeMicros();
+	r = connect(fd, (const sockaddr*)&conn.dest, family==AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+	if(r && errno == EINPROGRESS) {
+		opened.push_back(seq);
+		return IP_SUCCESS;
+	}
+	if(r && errno != ECONNREFUSED) {
+		DWORD status = SendError(errno);
+		CloseTcp(slot);
+		return status;
+	}
+	s_probe_reply reply;
+	memset(&reply, 0, sizeof(reply));
+	reply.seq = seq;
+	reply.status = r ? IP_DEST_PORT_UNREACHABLE : IP_SUCCESS;
+	reply.rtt = GetRTT(seq, 0);
+	memcpy(&reply.addr6, &conn.dest, sizeof(reply.addr6));
+	completed.push_back(reply);
+	CloseTcp(slot);
+	return IP_SUCCESS;
+}
+
+void WinMTRProbeLinux::CloseTcp(int slot)
+{
+	s_tcpprobe& conn = conns[slot];
+	if(conn.fd < 0)
+		return;
+	close(conn.fd);// leaves the epoll set with it
+	conn.fd = -1;
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::WaitTcp
+//
+//
+//*****************************************************************************
+int WinMTRProbeLinux::WaitTcp(DWORD timeout, s_probe_reply* replies, int count)
+{
+	epoll_event events[RECEIVE_BATCH];
+	int n = 0;
+	int r = epoll_wait(sock, events, count < RECEIVE_BATCH ? count : RECEIVE_BATCH, (int)timeout);
+	for(int i=0; i<r; ++i)
+		if(ReceiveTcp(events[i].data.u32, replies[n]))
+			++n;
+	ExpireTcp();
+	return n;
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::ReceiveTcp
+//
+// Ends the connect of a slot. An ICMP error is in the error queue of its
+// socket, a SYN-ACK or a RST is the result of the connect.
+//*****************************************************************************
+bool WinMTRProbeLinux::ReceiveTcp(int slot, s_probe_reply& reply)
+{
+	s_tcpprobe& conn = conns[slot];
+	if(conn.fd < 0)
+		return false;
+	// After a retransmitted SYN the answer may be to either of them and the
+	// kernel has no RTT either (Karn), the probe is lost instead
+	tcp_info info;
+	socklen_t len = sizeof(info);
+	memset(&info, 0, sizeof(info));
+	if(!getsockopt(conn.fd, IPPROTO_TCP, TCP_INFO, &info, &len) && (info.tcpi_total_retrans || info.tcpi_retransmits)) {
+		CloseTcp(slot);
+		return false;
+	}
+	char data[ERROR_DATA];
+	char control[512];
+	sockaddr_in6 target;
+	iovec iov = {data, sizeof(data)};
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &target;
+	msg.msg_namelen = sizeof(target);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	memset(&reply, 0, sizeof(reply));
+	reply.seq = sent[slot].seq;
+	const sock_extended_err* ee = NULL;
+	if(recvmsg(conn.fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0) {
+		for(cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+			   (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+				ee = (const sock_extended_err*)CMSG_DATA(cmsg);
+		}
+	}
+	if(ee && (ee->ee_origin == SO_EE_ORIGIN_ICMP || ee->ee_origin == SO_EE_ORIGIN_ICMP6)) {
+		reply.status = GetStatus(ee);
+		reply.rtt = GetRTT(reply.seq, GetReceiveTime(&msg));
+		const sockaddr* offender = SO_EE_OFFENDER(ee);
+		if(offender->sa_family == AF_INET6)
+			reply.addr6 = *(const sockaddr_in6*)offender;
+		else if(offender->sa_family == AF_INET)
+			reply.addr = *(const sockaddr_in*)offender;
+		CloseTcp(slot);
+		return true;
+	}
+	int err = 0;
+	len = sizeof(err);
+	getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+	reply.rtt = GetRTT(reply.seq, 0);
+	if(!err) {
+		// the SYN-ACK isn't timestamped, the RTT the kernel measured is
+		if(info.tcpi_rtt)
+			reply.rtt = info.tcpi_rtt;
+		reply.status = IP_SUCCESS;
+	} else if(err == ECONNREFUSED) {
+		reply.status = IP_DEST_PORT_UNREACHABLE;
+	} else {
+		CloseTcp(slot);// the SYN went unanswered, or an error without the ICMP message
+		return false;
+	}
+	memcpy(&reply.addr6, &conn.dest, sizeof(reply.addr6));
+	CloseTcp(slot);
+	return true;
+}
+
+// closes the connects that are past ECHO_REPLY_TIMEOUT, WinMTRNet counts them as lost
+void WinMTRProbeLinux::ExpireTcp()
+{
+	ULONGLONG now = GetTimeMicros();
+	while(!opened.empty()) {
+		int slot = opened.front() & (conns.size() - 1);
+		if(conns[slot].fd >= 0 && sent[slot].seq == opened.front()) {
+			if(now - sent[slot].monotonic < (ULONGLONG)ECHO_REPLY_TIMEOUT * 1000)
+				break;
+			CloseTcp(slot);
+		}
+		opened.pop_front();
+	}
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::Wait
+//
+//
+//*****************************************************************************
+int WinMTRProbeLinux::Wait(DWORD timeout, s_probe_reply* replies, int count)
+{
+	int n = 0;
+	for(; n < count && !completed.empty(); ++n) {
+		replies[n] = completed.back();
+		completed.pop_back();
+	}
+	if(type == PROBE_TCP)
+		return n + WaitTcp(n ? 0 : timeout, replies + n, count - n);
+	pollfd pfd = {sock, POLLIN, 0};
+	if(poll(&pfd, 1, n ? 0 : (int)timeout) <= 0) return n;
+	// POLLERR is reported for a non-empty error queue
+	if(pfd.revents & POLLERR) n += ReceiveErrors(replies + n, count - n);
+	while(n < count && (pfd.revents & POLLIN) && ReceiveReply(replies[n])) ++n;
+	return n;
+}
+
+//*****************************************************************************
+// WinMTRProbe::WaitAny
+//
+// One poll() over the sockets of all backends.
+//*****************************************************************************
+void WinMTRProbe::WaitAny(WinMTRProbe** probes, int count, DWORD timeout)
+{
+	pollfd pfd[2];
+	std::vector<pollfd> more;
+	pollfd* fds = pfd;
+	if(count > 2) {
+		more.resize(count);
+		fds = &more[0];
+	}
+	for(int i=0; i<count; ++i) {
+		fds[i].fd = ((WinMTRProbeLinux*)probes[i])->sock;
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+		if(!((WinMTRProbeLinux*)probes[i])->completed.empty())
+			timeout = 0;
+	}
+	poll(fds, count, (int)timeout);
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::ReceiveReply
+//
+// Reads one echo reply, returns false when there is none left. A UDP
+// destination that answers from the port of a probe is taken as reached.
+//*****************************************************************************
+bool WinMTRProbeLinux::ReceiveReply(s_probe_reply& reply)
+{
+	char buf[sizeof(s_icmp_echo) + 64];
+	char control[128];
+	for(;;) {
+		memset(&reply,0,sizeof(reply));
+		iovec iov = {buf, sizeof(buf)};
+		msghdr msg;
+		memset(&msg,0,sizeof(msg));
+		msg.msg_name = &reply.addr6;
+		msg.msg_namelen = sizeof(reply.addr6);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		ssize_t len = recvmsg(sock, &msg, MSG_DONTWAIT);
+		if(len < 0) {
+			switch(errno) {
+			case EHOSTUNREACH:
+			case ENETUNREACH:
+			case ECONNREFUSED:
+			case EPROTO:
+			case EINTR:
+				continue;// pending ICMP error reported by the socket, handled through the error queue
+			default:
+				return false;
+			}
+		}
+		if(type == PROBE_UDP) {
+			int slot = MatchUdp(reply.addr6);
+			if(slot < 0)
+				continue;
+			sent[slot].inflight = false;
+			reply.seq = sent[slot].seq;
+			reply.status = IP_SUCCESS;
+			reply.rtt = GetRTT(reply.seq, GetReceiveTime(&msg));
+			return true;
+		}
+		const s_icmp_echo* icmp = (const s_icmp_echo*)buf;
+		if(len < (ssize_t)sizeof(s_icmp_echo) || icmp->type != (family==AF_INET6 ? ICMP6_ECHO_REPLY : ICMP4_ECHO_REPLY))
+			continue;
+		reply.seq = ntohs(icmp->seq);
+		reply.status = IP_SUCCESS;
+		reply.rtt = GetRTT(reply.seq, GetReceiveTime(&msg));
+		return true;
+	}
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::ReceiveErrors
+//
+// Reads up to count ICMP errors from the error queue, RECEIVE_BATCH per
+// recvmmsg(). Returns the number of them that belong to a probe.
+//*****************************************************************************
+int WinMTRProbeLinux::ReceiveErrors(s_probe_reply* replies, int count)
+{
+	mmsghdr msgs[RECEIVE_BATCH];
+	iovec iov[RECEIVE_BATCH];
+	char data[RECEIVE_BATCH][ERROR_DATA];
+	char control[RECEIVE_BATCH][512];
+	sockaddr_in6 target[RECEIVE_BATCH];
+	int n = 0;
+	while(n < count) {
+		int batch = count - n < RECEIVE_BATCH ? count - n : RECEIVE_BATCH;
+		memset(msgs, 0, sizeof(mmsghdr) * batch);
+		for(int i=0; i<batch; ++i) {
+			iov[i].iov_base = data[i];
+			iov[i].iov_len = ERROR_DATA;
+			msghdr& msg = msgs[i].msg_hdr;
+			msg.msg_name = &target[i];
+			msg.msg_namelen = sizeof(target[i]);
+			msg.msg_iov = &iov[i];
+			msg.msg_iovlen = 1;
+			msg.msg_control = control[i];
+			msg.msg_controllen = sizeof(control[i]);
+		}
+		int r = recvmmsg(sock, msgs, batch, MSG_ERRQUEUE | MSG_DONTWAIT, NULL);
+		if(r <= 0)
+			break;
+		for(int i=0; i<r; ++i)
+			if(ParseError(&msgs[i].msg_hdr, msgs[i].msg_len, data[i], target[i], replies[n]))
+				++n;
+		if(r < batch)
+			break;
+	}
+	return n;
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::MatchUdp
+//
+// The slot of the UDP probe in flight that an answer or error is for, -1 if
+// none. peer is the port the probe went to.
+//*****************************************************************************
+int WinMTRProbeLinux::MatchUdp(const sockaddr_in6& peer)
+{
+	unsigned port = (unsigned short)(ntohs(peer.sin6_port) - UDP_BASE_PORT);
+	if(port >= sent.size() || !sent[port].inflight)
+		return -1;
+	return port;
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::ParseError
+//
+// The data of an error is the start of the probe it was generated for: the
+// echo request, or the payload of a UDP probe. A UDP probe is found by the
+// port it was sent to, target.
+//*****************************************************************************
+bool WinMTRProbeLinux::ParseError(msghdr* msg, size_t len, const char* data, const sockaddr_in6& target, s_probe_reply& reply)
+{
+	const sock_extended_err* ee = NULL;
+	for(cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+		   (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+			ee = (const sock_extended_err*)CMSG_DATA(cmsg);
+	}
+	if(!ee)
+		return false;
+
+	memset(&reply,0,sizeof(reply));
+	if(type == PROBE_UDP) {
+		int slot = MatchUdp(target);
+		if(slot < 0)
+			return false;// answered already, or not ours
+		sent[slot].inflight = false;
+		reply.seq = sent[slot].seq;
+	} else {
+		if(len < sizeof(s_icmp_echo))
+			return false;
+		reply.seq = ntohs(((const s_icmp_echo*)data)->seq);
+	}
+	reply.status = GetStatus(ee);
+	reply.rtt = GetRTT(reply.seq, GetReceiveTime(msg));
+	const sockaddr* offender = SO_EE_OFFENDER(ee);
+	if(offender->sa_family == AF_INET6)
+		reply.addr6 = *(const sockaddr_in6*)offender;
+	else if(offender->sa_family == AF_INET)
+		reply.addr = *(const sockaddr_in*)offender;
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::GetStatus
+//
+// Translates an extended socket error into the IP_* status of the Windows
+// ICMP API, so WinMTRNet handles both the same way.
+//*****************************************************************************
+DWORD WinMTRProbeLinux::GetStatus(const sock_extended_err* ee)
+{
+	if(ee->ee_origin == SO_EE_ORIGIN_ICMP) {
+		switch(ee->ee_type) {
+		case ICMP4_TIME_EXCEEDED:
+			return ee->ee_code ? IP_TTL_EXPIRED_REASSEM : IP_TTL_EXPIRED_TRANSIT;
+		case ICMP4_DEST_UNREACH:
+			switch(ee->ee_code) {
+			case 0: return IP_DEST_NET_UNREACHABLE;
+			case 2: return IP_DEST_PROT_UNREACHABLE;
+			case 3: return IP_DEST_PORT_UNREACHABLE;
+			case 4: return IP_PACKET_TOO_BIG;
+			case 5: return IP_BAD_ROUTE;
+			default: return IP_DEST_HOST_UNREACHABLE;
+			}
+		case 4:
+			return IP_SOURCE_QUENCH;
+		case 12:
+			return IP_PARAM_PROBLEM;
+		}
+	} else if(ee->ee_origin == SO_EE_ORIGIN_ICMP6) {
+		switch(ee->ee_type) {
+		case ICMP6_TIME_EXCEEDED:
+			return ee->ee_code ? IP_TTL_EXPIRED_REASSEM : IP_TTL_EXPIRED_TRANSIT;
+		case ICMP6_PACKET_TOO_BIG:
+			return IP_PACKET_TOO_BIG;
+		case ICMP6_DEST_UNREACH:
+			switch(ee->ee_code) {
+			case 0: return IP_DEST_NET_UNREACHABLE;
+			case 4: return IP_DEST_PORT_UNREACHABLE;
+			default: return IP_DEST_HOST_UNREACHABLE;
+			}
+		case 4:
+			return IP_PARAM_PROBLEM;
+		}
+	} else if(ee->ee_errno == EMSGSIZE) {
+		return IP_PACKET_TOO_BIG;
+	}
+	return IP_GENERAL_FAILURE;
+}
+
+//*****************************************************************************
+// WinMTRProbeLinux::GetRTT
+//
+// Round trip time in us of the probe seq, received is the kernel timestamp
+// of its reply or 0. The realtime clock can be stepped while a probe is out,
+// so a timestamp that doesn't fit the monotonic clock is not used.
+//*****************************************************************************
+DWORD WinMTRProbeLinux::GetRTT(unsigned short seq, ULONGLONG received)
+{
+	const s_sendtime& when = sent[seq & (sent.size() - 1)];
+	ULONGLONG elapsed = GetTimeMicros() - when.monotonic;
+	if(received >= when.realtime && received - when.realtime <= elapsed)
+		return (DWORD)(received - when.realtime);
+	return (DWORD)elapsed;
+}
+
+ULONGLONG WinMTRProbeLinux::GetRealtimeMicros()
+{
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (ULONGLONG)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// the SO_TIMESTAMPNS receive time of a message in us, 0 if it has none
+ULONGLONG WinMTRProbeLinux::GetReceiveTime(msghdr* msg)
+{
+	for(cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			timespec ts;
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			return (ULONGLONG)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+		}
+	}
+	return 0;
+}
+
+#endif // __linux__
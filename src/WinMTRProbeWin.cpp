@@ -0,0 +1,337 @@
+//*****************************************************************************
+// FILE:            WinMTRProbeWin.cpp
+//
+//
+// DESCRIPTION:
+//   Probe backend on top of the Iphlpapi.dll ICMP API. Requests are sent in
+//   APC mode, their completion routines run while the tracing thread waits
+//   alertable in Wait().
+//
+// NOTES:
+//   The ICMP API only reports whole milliseconds. The round trip time is
+//   measured on the high resolution clock from the send to the completion
+//   routine instead, bounded by the time of the driver in case the routine
+//   ran late.
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRProbe.h"
+
+#ifdef _WIN32
+
+#include <VersionHelpers.h>
+#include <vector>
+
+typedef IP_OPTION_INFORMATION IPINFO, *PIPINFO, FAR* LPIPINFO;
+#ifdef _WIN64
+typedef ICMP_ECHO_REPLY32 ICMPECHO, *PICMPECHO, FAR* LPICMPECHO;
+#else
+typedef ICMP_ECHO_REPLY ICMPECHO, *PICMPECHO, FAR* LPICMPECHO;
+#endif // _WIN64
+
+#define IPFLAG_DONT_FRAGMENT	0x02
+#define IO_STATUS_BLOCK_SIZE	(2*sizeof(void*))
+
+class WinMTRProbeWin;
+
+struct s_icmp_request {
+	WinMTRProbeWin*	owner;
+	unsigned short	seq;
+	bool			pending;	// reply buffer in use by the ICMP driver
+	ULONGLONG		sent;		// GetTimeMicros() before the request was sent
+	char*			reply;
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRProbeWin
+//
+//
+//*****************************************************************************
+
+class WinMTRProbeWin : public WinMTRProbe
+{
+	typedef VOID (NTAPI* PIO_APC_ROUTINE)(PVOID ApcContext, PVOID IoStatusBlock, ULONG Reserved);// IoStatusBlock is unused, no need for winternl.h
+	//IPv4
+	typedef HANDLE(WINAPI* LPFNICMPCREATEFILE)(VOID);
+	typedef BOOL (WINAPI* LPFNICMPCLOSEHANDLE)(HANDLE);
+	typedef DWORD (WINAPI* LPFNICMPSENDECHO2)(HANDLE IcmpHandle,HANDLE Event,PIO_APC_ROUTINE ApcRoutine,PVOID ApcContext,in_addr DestinationAddress,LPVOID RequestData,WORD RequestSize,PIP_OPTION_INFORMATION RequestOptions,LPVOID ReplyBuffer,DWORD ReplySize,DWORD Timeout);
+	typedef DWORD (WINAPI* LPFNICMPPARSEREPLIES)(LPVOID ReplyBuffer,DWORD ReplySize);
+	//IPv6
+	typedef HANDLE(WINAPI* LPFNICMP6CREATEFILE)(VOID);
+	typedef DWORD (WINAPI* LPFNICMP6SENDECHO2)(HANDLE IcmpHandle,HANDLE Event,PIO_APC_ROUTINE ApcRoutine,PVOID ApcContext,sockaddr_in6* SourceAddress,sockaddr_in6* DestinationAddress,LPVOID RequestData,WORD RequestSize,PIP_OPTION_INFORMATION RequestOptions,LPVOID ReplyBuffer,DWORD ReplySize,DWORD Timeout);
+	typedef DWORD (WINAPI* LPFNICMP6PARSEREPLIES)(LPVOID ReplyBuffer,DWORD ReplySize);
+
+public:
+	WinMTRProbeWin(int family, int slots);
+	~WinMTRProbeWin();
+
+	bool	Init(std::string& error);
+	DWORD	Send(unsigned short seq, int ttl, const sockaddr* dest, const char* data, WORD size);
+	int		GetSlots();
+	int		Wait(DWORD timeout, s_probe_reply* replies, int count);
+	void	OnReply(s_icmp_request* request);
+
+private:
+	static DWORD	GetRTT(const s_icmp_request* request, ULONG roundTripTime);
+
+	int					family;
+	HINSTANCE			hICMP_DLL;
+	HANDLE				hICMP;
+
+	LPFNICMPCREATEFILE lpfnIcmpCreateFile;
+	LPFNICMPCLOSEHANDLE lpfnIcmpCloseHandle;
+	LPFNICMPSENDECHO2 lpfnIcmpSendEcho2;
+	LPFNICMPPARSEREPLIES lpfnIcmpParseReplies;
+	LPFNICMP6CREATEFILE lpfnIcmp6CreateFile;
+	LPFNICMP6SENDECHO2 lpfnIcmp6SendEcho2;
+	LPFNICMP6PARSEREPLIES lpfnIcmp6ParseReplies;
+
+	std::vector<s_icmp_request> requests;	// per seq & (slots - 1)
+	char*				replyBuffers;
+	DWORD				replySize;		// size of each request's reply buffer
+	int					pending;
+	std::vector<s_probe_reply> completed;	// filled by the APCs, drained by Wait()
+
+	friend class WinMTRProbe;
+};
+
+VOID NTAPI ProbeReplyApc(PVOID ApcContext, PVOID IoStatusBlock, ULONG Reserved);
+
+//*****************************************************************************
+// WinMTRProbe::Create
+//
+// The ICMP API only sends echo requests, UDP and TCP probes would need raw
+// sockets. The errors are left to the caller, the headless modes have no
+// window to show them in.
+//*****************************************************************************
+WinMTRProbe* WinMTRProbe::Create(int family, int slots, int type, WORD port, std::string* error)
+{
+	if(type != PROBE_ICMP) {
+		if(error) *error = "UDP and TCP probes are not available on Windows!";
+		return NULL;
+	}
+	WinMTRProbeWin* probe = new WinMTRProbeWin(family, slots);
+	std::string reason;
+	if(!probe->Init(reason)) {
+		if(error) *error = reason;
+		delete probe;
+		return NULL;
+	}
+	return probe;
+}
+
+WinMTRProbeWin::WinMTRProbeWin(int family, int slots)
+	: family(family), hICMP_DLL(NULL), hICMP(INVALID_HANDLE_VALUE),
+	  replyBuffers(NULL), replySize(0), pending(0)
+{
+	s_icmp_request request = {0};
+	requests.resize(slots, request);
+}
+
+WinMTRProbeWin::~WinMTRProbeWin()
+{
+	// reply buffers have to stay valid until the driver completed every request
+	while(pending) SleepEx(INFINITE, TRUE);
+
+	if(hICMP != INVALID_HANDLE_VALUE) lpfnIcmpCloseHandle(hICMP);
+	if(hICMP_DLL) FreeLibrary(hICMP_DLL);
+	delete[] replyBuffers;
+}
+
+bool WinMTRProbeWin::Init(std::string& error)
+{
+	OSVERSIONINFOEX osvi= {0};
+	osvi.dwOSVersionInfoSize=sizeof(OSVERSIONINFOEX);
+	if(!IsWindows8OrGreater()) {
+		error = "Failed to get Windows version!";
+		return false;
+	}
+	if(osvi.dwMajorVersion==5 && osvi.dwMinorVersion==0) { //w2k
+		hICMP_DLL=LoadLibrary(_T("ICMP.DLL"));
+		if(!hICMP_DLL) {
+			error = "Failed: Unable to locate ICMP.DLL!";
+			return false;
+		}
+	} else {
+		hICMP_DLL=LoadLibrary(_T("Iphlpapi.dll"));
+		if(!hICMP_DLL) {
+			error = "Failed: Unable to locate Iphlpapi.dll!";
+			return false;
+		}
+	}
+
+	/*
+	 * Get pointers to ICMP.DLL functions
+	 */
+	lpfnIcmpCloseHandle = (LPFNICMPCLOSEHANDLE)GetProcAddress(hICMP_DLL,"IcmpCloseHandle");
+	if(family==AF_INET6) {
+		lpfnIcmp6CreateFile=(LPFNICMP6CREATEFILE)GetProcAddress(hICMP_DLL,"Icmp6CreateFile");
+		lpfnIcmp6SendEcho2=(LPFNICMP6SENDECHO2)GetProcAddress(hICMP_DLL,"Icmp6SendEcho2");
+		lpfnIcmp6ParseReplies=(LPFNICMP6PARSEREPLIES)GetProcAddress(hICMP_DLL,"Icmp6ParseReplies");
+		if(!lpfnIcmpCloseHandle || !lpfnIcmp6CreateFile || !lpfnIcmp6SendEcho2 || !lpfnIcmp6ParseReplies) {
+			error = "IPv6 support not found!";
+			return false;
+		}
+		/*
+		 * Icmp6CreateFile() - Open the ping service
+		 */
+		hICMP=(HANDLE)lpfnIcmp6CreateFile();
+		if(hICMP==INVALID_HANDLE_VALUE) {
+			error = "Error in ICMPv6 module!";
+			return false;
+		}
+	} else {
+		lpfnIcmpCreateFile  = (LPFNICMPCREATEFILE)GetProcAddress(hICMP_DLL,"IcmpCreateFile");
+		lpfnIcmpSendEcho2   = (LPFNICMPSENDECHO2)GetProcAddress(hICMP_DLL,"IcmpSendEcho2");
+		lpfnIcmpParseReplies= (LPFNICMPPARSEREPLIES)GetProcAddress(hICMP_DLL,"IcmpParseReplies");
+		if(!lpfnIcmpCreateFile || !lpfnIcmpCloseHandle || !lpfnIcmpSendEcho2 || !lpfnIcmpParseReplies) {
+			error = "Wrong ICMP system library !";
+			return false;
+		}
+		/*
+		 * IcmpCreateFile() - Open the ping service
+		 */
+		hICMP = (HANDLE) lpfnIcmpCreateFile();
+		if(hICMP == INVALID_HANDLE_VALUE) {
+			error = "Error in ICMP module!";
+			return false;
+		}
+	}
+	for(size_t i=0; i<requests.size(); ++i) requests[i].owner = this;
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRProbeWin::Send
+//
+//
+//*****************************************************************************
+DWORD WinMTRProbeWin::Send(unsigned short seq, int ttl, const sockaddr* dest, const char* data, WORD size)
+{
+	static sockaddr_in6 sockaddrfrom= {AF_INET6,0,0,in6addr_any,0};
+	DWORD needed = sizeof(ICMPECHO) + sizeof(ICMPV6_ECHO_REPLY) + size + 8 + IO_STATUS_BLOCK_SIZE;
+	if(needed > replySize) {
+		if(pending) return IP_BUF_TOO_SMALL;// ping size can't change while tracing
+		delete[] replyBuffers;
+		replyBuffers = new char[needed * requests.size()];
+		replySize = needed;
+		for(size_t i=0; i<requests.size(); ++i) requests[i].reply = replyBuffers + replySize * i;
+	}
+	s_icmp_request* request = &requests[seq & (requests.size() - 1)];
+	if(request->pending) return IP_NO_RESOURCES;
+	request->seq = seq;
+	request->sent = GetTimeMicros();
+
+	IPINFO stIPInfo;
+	stIPInfo.Ttl			= (UCHAR)ttl;
+	stIPInfo.Tos			= 0;
+	stIPInfo.Flags			= IPFLAG_DONT_FRAGMENT;
+	stIPInfo.OptionsSize	= 0;
+	stIPInfo.OptionsData	= NULL;
+	DWORD dwReplyCount;
+	if(family==AF_INET6)
+		dwReplyCount = lpfnIcmp6SendEcho2(hICMP, NULL, ProbeReplyApc, request, &sockaddrfrom, (sockaddr_in6*)dest, (LPVOID)data, size, &stIPInfo, request->reply, replySize, ECHO_REPLY_TIMEOUT);
+	else
+		dwReplyCount = lpfnIcmpSendEcho2(hICMP, NULL, ProbeReplyApc, request, ((sockaddr_in*)dest)->sin_addr, (LPVOID)data, size, &stIPInfo, request->reply, replySize, ECHO_REPLY_TIMEOUT);
+	DWORD err = GetLastError();
+	if(!dwReplyCount && err != ERROR_IO_PENDING) {
+		// request failed right away, no APC will be queued for it
+		return err;
+	}
+	request->pending = true;
+	++pending;
+	return IP_SUCCESS;
+}
+
+int WinMTRProbeWin::GetSlots()
+{
+	return (int)requests.size();
+}
+
+//*****************************************************************************
+// WinMTRProbeWin::Wait
+//
+//
+//*****************************************************************************
+int WinMTRProbeWin::Wait(DWORD timeout, s_probe_reply* replies, int count)
+{
+	if(completed.empty())
+		SleepEx(timeout, TRUE);// replies are collected by ProbeReplyApc from within here
+	int n = 0;
+	for(; n < count && n < (int)completed.size(); ++n) replies[n] = completed[n];
+	completed.erase(completed.begin(), completed.begin() + n);
+	return n;
+}
+
+//*****************************************************************************
+// WinMTRProbe::WaitAny
+//
+// The APCs of every backend run on the waiting thread, so one alertable
+// sleep waits for all of them.
+//*****************************************************************************
+void WinMTRProbe::WaitAny(WinMTRProbe** probes, int count, DWORD timeout)
+{
+	for(int i=0; i<count; ++i)
+		if(!((WinMTRProbeWin*)probes[i])->completed.empty())
+			return;
+	SleepEx(timeout, TRUE);
+}
+
+//*****************************************************************************
+// ProbeReplyApc
+//
+// Completion routine of IcmpSendEcho2/Icmp6SendEcho2, runs on the tracing
+// thread.
+//*****************************************************************************
+VOID NTAPI ProbeReplyApc(PVOID ApcContext, PVOID /*IoStatusBlock*/, ULONG /*Reserved*/)
+{
+	s_icmp_request* request = (s_icmp_request*)ApcContext;
+	request->owner->OnReply(request);
+}
+
+//*****************************************************************************
+// WinMTRProbeWin::OnReply
+//
+//
+//*****************************************************************************
+void WinMTRProbeWin::OnReply(s_icmp_request* request)
+{
+	s_probe_reply reply;
+	memset(&reply,0,sizeof(reply));
+	reply.seq = request->seq;
+	if(family==AF_INET6) {
+		ICMPV6_ECHO_REPLY* icmpv6_echo_reply = (ICMPV6_ECHO_REPLY*)request->reply;
+		if(lpfnIcmp6ParseReplies(request->reply, replySize)) {
+			reply.status = icmpv6_echo_reply->Status;
+			reply.rtt = GetRTT(request, icmpv6_echo_reply->RoundTripTime);
+			reply.addr6.sin6_family = AF_INET6;
+			memcpy(&reply.addr6.sin6_addr, icmpv6_echo_reply->Address.sin6_addr, sizeof(in6_addr));
+		} else {
+			reply.status = GetLastError();
+		}
+	} else {
+		ICMPECHO* icmp_echo_reply = (ICMPECHO*)request->reply;// ICMP_ECHO_REPLY32 on Win64 when using an APC
+		if(lpfnIcmpParseReplies(request->reply, replySize)) {
+			reply.status = icmp_echo_reply->Status;
+			reply.rtt = GetRTT(request, icmp_echo_reply->RoundTripTime);
+			reply.addr.sin_family = AF_INET;
+			reply.addr.sin_addr.s_addr = icmp_echo_reply->Address;
+		} else {
+			reply.status = GetLastError();
+		}
+	}
+	request->pending = false;
+	--pending;
+	completed.push_back(reply);
+}
+
+// round trip time in us, at most the ms of the driver rounded up
+DWORD WinMTRProbeWin::GetRTT(const s_icmp_request* request, ULONG roundTripTime)
+{
+	ULONGLONG elapsed = GetTimeMicros() - request->sent;
+	ULONGLONG bound = ((ULONGLONG)roundTripTime + 1) * 1000;
+	return (DWORD)(elapsed < bound ? elapsed : bound);
+}
+
+#endif // _WIN32
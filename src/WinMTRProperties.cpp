@@ -77,13 +77,13 @@ BOOL WinMTRProperties::OnInitDialog()
 	sprintf(buf, "%d", pck_recv);
 	m_editRecv.SetWindowText(buf);
 
-	sprintf(buf, "%.1f", ping_last);
+	sprintf(buf, "%.3f", ping_last);
 	m_editLast.SetWindowText(buf);
-	sprintf(buf, "%.1f", ping_best);
+	sprintf(buf, "%.3f", ping_best);
 	m_editBest.SetWindowText(buf);
-	sprintf(buf, "%.1f", ping_worst);
+	sprintf(buf, "%.3f", ping_worst);
 	m_editWorst.SetWindowText(buf);
-	sprintf(buf, "%.1f", ping_avrg);
+	sprintf(buf, "%.3f", ping_avrg);
 	m_editAvrg.SetWindowText(buf);
 
 	return FALSE;
@@ -0,0 +1,563 @@
+//*****************************************************************************
+// FILE:            WinMTRRaster.cpp
+//
+// DESCRIPTION:     Implementation of the software framebuffer canvas and its
+//                  PNG encoder
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRRaster.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTER_SSE2
+#endif
+
+// 5x7 glyphs of the printable ASCII characters, one byte per column from the
+// left, bit 0 is the top row
+static const unsigned char Font5x7[95][5] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00 },   // ' '
+    { 0x00, 0x00, 0x5F, 0x00, 0x00 },   // !
+    { 0x00, 0x07, 0x00, 0x07, 0x00 },   // "
+    { 0x14, 0x7F, 0x14, 0x7F, 0x14 },   // #
+    { 0x24, 0x2A, 0x7F, 0x2A, 0x12 },   // $
+    { 0x23, 0x13, 0x08, 0x64, 0x62 },   // %
+    { 0x36, 0x49, 0x56, 0x20, 0x50 },   // &
+    { 0x00, 0x00, 0x07, 0x00, 0x00 },   // '
+    { 0x00, 0x1C, 0x22, 0x41, 0x00 },   // (
+    { 0x00, 0x41, 0x22, 0x1C, 0x00 },   // )
+    { 0x2A, 0x1C, 0x7F, 0x1C, 0x2A },   // *
+    { 0x08, 0x08, 0x3E, 0x08, 0x08 },   // +
+    { 0x00, 0x50, 0x30, 0x00, 0x00 },   // ,
+    { 0x08, 0x08, 0x08, 0x08, 0x08 },   // -
+    { 0x00, 0x60, 0x60, 0x00, 0x00 },   // .
+    { 0x20, 0x10, 0x08, 0x04, 0x02 },   // /
+    { 0x3E, 0x51, 0x49, 0x45, 0x3E },   // 0
+    { 0x00, 0x42, 0x7F, 0x40, 0x00 },   // 1
+    { 0x42, 0x61, 0x51, 0x49, 0x46 },   // 2
+    { 0x21, 0x41, 0x45, 0x4B, 0x31 },   // 3
+    { 0x18, 0x14, 0x12, 0x7F, 0x10 },   // 4
+    { 0x27, 0x45, 0x45, 0x45, 0x39 },   // 5
+    { 0x3C, 0x4A, 0x49, 0x49, 0x30 },   // 6
+    { 0x01, 0x71, 0x09, 0x05, 0x03 },   // 7
+    { 0x36, 0x49, 0x49, 0x49, 0x36 },   // 8
+    { 0x06, 0x49, 0x49, 0x29, 0x1E },   // 9
+    { 0x00, 0x36, 0x36, 0x00, 0x00 },   // :
+    { 0x00, 0x56, 0x36, 0x00, 0x00 },   // ;
+    { 0x08, 0x14, 0x22, 0x41, 0x00 },   // <
+    { 0x14, 0x14, 0x14, 0x14, 0x14 },   // =
+    { 0x00, 0x41, 0x22, 0x14, 0x08 },   // >
+    { 0x02, 0x01, 0x51, 0x09, 0x06 },   // ?
+    { 0x32, 0x49, 0x79, 0x41, 0x3E },   // @
+    { 0x7E, 0x11, 0x11, 0x11, 0x7E },   // A
+    { 0x7F, 0x49, 0x49, 0x49, 0x36 },   // B
+    { 0x3E, 0x41, 0x41, 0x41, 0x22 },   // C
+    { 0x7F, 0x41, 0x41, 0x22, 0x1C },   // D
+    { 0x7F, 0x49, 0x49, 0x49, 0x41 },   // E
+    { 0x7F, 0x09, 0x09, 0x09, 0x01 },   // F
+    { 0x3E, 0x41, 0x49, 0x49, 0x7A },   // G
+    { 0x7F, 0x08, 0x08, 0x08, 0x7F },   // H
+    { 0x00, 0x41, 0x7F, 0x41, 0x00 },   // I
+    { 0x20, 0x40, 0x41, 0x3F, 0x01 },   // J
+    { 0x7F, 0x08, 0x14, 0x22, 0x41 },   // K
+    { 0x7F, 0x40, 0x40, 0x40, 0x40 },   // L
+    { 0x7F, 0x02, 0x0C, 0x02, 0x7F },   // M
+    { 0x7F, 0x04, 0x08, 0x10, 0x7F },   // N
+    { 0x3E, 0x41, 0x41, 0x41, 0x3E },   // O
+    { 0x7F, 0x09, 0x09, 0x09, 0x06 },   // P
+    { 0x3E, 0x41, 0x51, 0x21, 0x5E },   // Q
+    { 0x7F, 0x09, 0x19, 0x29, 0x46 },   // R
+    { 0x46, 0x49, 0x49, 0x49, 0x31 },   // S
+    { 0x01, 0x01, 0x7F, 0x01, 0x01 },   // T
+    { 0x3F, 0x40, 0x40, 0x40, 0x3F },   // U
+    { 0x1F, 0x20, 0x40, 0x20, 0x1F },   // V
+    { 0x3F, 0x40, 0x38, 0x40, 0x3F },   // W
+    { 0x63, 0x14, 0x08, 0x14, 0x63 },   // X
+    { 0x07, 0x08, 0x70, 0x08, 0x07 },   // Y
+    { 0x61, 0x51, 0x49, 0x45, 0x43 },   // Z
+    { 0x00, 0x7F, 0x41, 0x41, 0x00 },   // [
+    { 0x02, 0x04, 0x08, 0x10, 0x20 },   // backslash
+    { 0x00, 0x41, 0x41, 0x7F, 0x00 },   // ]
+    { 0x04, 0x02, 0x01, 0x02, 0x04 },   // ^
+    { 0x40, 0x40, 0x40, 0x40, 0x40 },   // _
+    { 0x00, 0x01, 0x02, 0x04, 0x00 },   // `
+    { 0x20, 0x54, 0x54, 0x54, 0x78 },   // a
+    { 0x7F, 0x48, 0x44, 0x44, 0x38 },   // b
+    { 0x38, 0x44, 0x44, 0x44, 0x20 },   // c
+    { 0x38, 0x44, 0x44, 0x48, 0x7F },   // d
+    { 0x38, 0x54, 0x54, 0x54, 0x18 },   // e
+    { 0x08, 0x7E, 0x09, 0x01, 0x02 },   // f
+    { 0x0C, 0x52, 0x52, 0x52, 0x3E },   // g
+    { 0x7F, 0x08, 0x04, 0x04, 0x78 },   // h
+    { 0x00, 0x44, 0x7D, 0x40, 0x00 },   // i
+    { 0x20, 0x40, 0x44, 0x3D, 0x00 },   // j
+    { 0x7F, 0x10, 0x28, 0x44, 0x00 },   // k
+    { 0x00, 0x41, 0x7F, 0x40, 0x00 },   // l
+    { 0x7C, 0x04, 0x18, 0x04, 0x78 },   // m
+    { 0x7C, 0x08, 0x04, 0x04, 0x78 },   // n
+    { 0x38, 0x44, 0x44, 0x44, 0x38 },   // o
+    { 0x7C, 0x14, 0x14, 0x14, 0x08 },   // p
+    { 0x08, 0x14, 0x14, 0x18, 0x7C },   // q
+    { 0x7C, 0x08, 0x04, 0x04, 0x08 },   // r
+    { 0x48, 0x54, 0x54, 0x54, 0x20 },   // s
+    { 0x04, 0x3F, 0x44, 0x40, 0x20 },   // t
+    { 0x3C, 0x40, 0x40, 0x20, 0x7C },   // u
+    { 0x1C, 0x20, 0x40, 0x20, 0x1C },   // v
+    { 0x3C, 0x40, 0x30, 0x40, 0x3C },   // w
+    { 0x44, 0x28, 0x10, 0x28, 0x44 },   // x
+    { 0x0C, 0x50, 0x50, 0x50, 0x3C },   // y
+    { 0x44, 0x64, 0x54, 0x4C, 0x44 },   // z
+    { 0x00, 0x08, 0x36, 0x41, 0x00 },   // {
+    { 0x00, 0x00, 0x7F, 0x00, 0x00 },   // |
+    { 0x00, 0x41, 0x36, 0x08, 0x00 },   // }
+    { 0x10, 0x08, 0x08, 0x10, 0x08 }    // ~
+};
+
+#define GLYPH_ADVANCE 6     // columns per character including the gap
+#define GLYPH_HEIGHT 7
+
+// Text of 14 points and more is drawn at twice the size
+static int FontScale(int size)
+{
+    return size >= 14 ? 2 : 1;
+}
+
+// Color bytes in pixel order, opaque
+static void ColorBytes(unsigned int color, unsigned char bytes[4])
+{
+    bytes[0] = (unsigned char)(color >> 16);
+    bytes[1] = (unsigned char)(color >> 8);
+    bytes[2] = (unsigned char)color;
+    bytes[3] = 255;
+}
+
+// Blend toward the color by alpha 0..256
+static inline void BlendPixel(unsigned char* p, const unsigned char color[4], int alpha)
+{
+    for (int c = 0; c < 4; c++) {
+        p[c] = (unsigned char)((p[c] * (256 - alpha) + color[c] * alpha) >> 8);
+    }
+}
+
+WinMTRRaster::WinMTRRaster(int width, int height)
+{
+    m_width = width > 0 ? width : 0;
+    m_height = height > 0 ? height : 0;
+    m_pixels.assign((size_t)m_width * m_height * 4, 0);
+    for (size_t i = 3; i < m_pixels.size(); i += 4) m_pixels[i] = 255;
+    ResetClip();
+}
+
+void WinMTRRaster::SetClip(int x, int y, int width, int height)
+{
+    m_clipLeft = x > 0 ? x : 0;
+    m_clipTop = y > 0 ? y : 0;
+    m_clipRight = x + width < m_width ? x + width : m_width;
+    m_clipBottom = y + height < m_height ? y + height : m_height;
+}
+
+void WinMTRRaster::ResetClip()
+{
+    m_clipLeft = 0;
+    m_clipTop = 0;
+    m_clipRight = m_width;
+    m_clipBottom = m_height;
+}
+
+void WinMTRRaster::FillRect(int x, int y, int width, int height, unsigned int color)
+{
+    int left = x > m_clipLeft ? x : m_clipLeft;
+    int top = y > m_clipTop ? y : m_clipTop;
+    int right = x + width < m_clipRight ? x + width : m_clipRight;
+    int bottom = y + height < m_clipBottom ? y + height : m_clipBottom;
+    if (left >= right || top >= bottom) return;
+
+    unsigned char bytes[4];
+    ColorBytes(color, bytes);
+    int alpha = (int)(color >> 24);
+
+    for (int row = top; row < bottom; row++) {
+        unsigned char* p = &m_pixels[((size_t)row * m_width + left) * 4];
+        if (alpha == 255) {
+            for (int i = left; i < right; i++, p += 4) memcpy(p, bytes, 4);
+        } else {
+            for (int i = left; i < right; i++, p += 4) BlendPixel(p, bytes, alpha + (alpha >> 7));
+        }
+    }
+}
+
+void WinMTRRaster::DrawLine(float x0, float y0, float x1, float y1, float width, unsigned int color)
+{
+    DrawSegment(x0, y0, x1, y1, width / 2, color);
+}
+
+void WinMTRRaster::DrawLines(const s_canvaspoint* points, int count, float width, unsigned int color)
+{
+    // the round caps of the segments make the round joins
+    for (int i = 1; i < count; i++) {
+        DrawSegment(points[i - 1].x, points[i - 1].y, points[i].x, points[i].y, width / 2, color);
+    }
+}
+
+//*****************************************************************************
+// WinMTRRaster::DrawSegment
+//
+// A line of the given radius with round caps. The coverage of a pixel is
+// how far its center lies inside the edge, 1 from half a pixel in. Each row
+// only visits the pixels within reach of the part of the segment near it.
+//*****************************************************************************
+void WinMTRRaster::DrawSegment(float x0, float y0, float x1, float y1, float radius, unsigned int color)
+{
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float len2 = dx * dx + dy * dy;
+    float invLen2 = len2 > 0 ? 1.0f / len2 : 0.0f;
+    float reach = radius + 0.5f;   // distance where the coverage drops to 0
+
+    int top = (int)floorf((y0 < y1 ? y0 : y1) - reach);
+    int bottom = (int)ceilf((y0 > y1 ? y0 : y1) + reach);
+    if (top < m_clipTop) top = m_clipTop;
+    if (bottom > m_clipBottom) bottom = m_clipBottom;
+
+    unsigned char bytes[4];
+    ColorBytes(color, bytes);
+    float alphaScale = (float)(color >> 24) * (256.0f / 255.0f);
+
+    for (int row = top; row < bottom; row++) {
+        float cy = row + 0.5f;
+
+        // x extent of the centerline within reach of this row
+        float tFrom = 0, tTo = 1;
+        if (dy != 0) {
+            tFrom = (cy - reach - y0) / dy;
+            tTo = (cy + reach - y0) / dy;
+            if (tFrom > tTo) { float t = tFrom; tFrom = tTo; tTo = t; }
+            if (tFrom < 0) tFrom = 0;
+            if (tTo > 1) tTo = 1;
+            if (tFrom > tTo) continue;
+        } else if (fabsf(y0 - cy) > reach) {
+            continue;
+        }
+        float xa = x0 + tFrom * dx;
+        float xb = x0 + tTo * dx;
+        if (xa > xb) { float x = xa; xa = xb; xb = x; }
+
+        int left = (int)floorf(xa - reach);
+        int right = (int)ceilf(xb + reach) + 1;
+        if (left < m_clipLeft) left = m_clipLeft;
+        if (right > m_clipRight) right = m_clipRight;
+
+        unsigned char* p = &m_pixels[((size_t)row * m_width + left) * 4];
+        float vy = cy - y0;
+        int x = left;
+
+#ifdef RASTER_SSE2
+        const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy);
+        const __m128 vinv = _mm_set1_ps(invLen2), vvy = _mm_set1_ps(vy);
+        const __m128 vreach = _mm_set1_ps(reach), vscale = _mm_set1_ps(alphaScale);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+        const __m128i src = _mm_setr_epi16(bytes[0], bytes[1], bytes[2], bytes[3], bytes[0], bytes[1], bytes[2], bytes[3]);
+        const __m128i full = _mm_set1_epi16(256);
+
+        for (; x + 4 <= right; x += 4, p += 16) {
+            __m128 vx = _mm_add_ps(_mm_set1_ps((float)x - x0), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(vx, vdx), _mm_mul_ps(vvy, vdy)), vinv);
+            t = _mm_min_ps(_mm_max_ps(t, zero), one);
+            __m128 ex = _mm_sub_ps(vx, _mm_mul_ps(t, vdx));
+            __m128 ey = _mm_sub_ps(vvy, _mm_mul_ps(t, vdy));
+            __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+            __m128 cover = _mm_min_ps(_mm_max_ps(_mm_sub_ps(vreach, d), zero), one);
+            __m128i alpha = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cover, vscale), half));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) == 0xFFFF) continue;
+
+            // alpha of each pixel repeated over its four channels
+            __m128i a16 = _mm_packs_epi32(alpha, alpha);
+            a16 = _mm_unpacklo_epi16(a16, a16);
+            __m128i aLo = _mm_unpacklo_epi32(a16, a16);
+            __m128i aHi = _mm_unpackhi_epi32(a16, a16);
+
+            __m128i dst = _mm_loadu_si128((const __m128i*)p);
+            __m128i dLo = _mm_unpacklo_epi8(dst, _mm_setzero_si128());
+            __m128i dHi = _mm_unpackhi_epi8(dst, _mm_setzero_si128());
+            dLo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(dLo, _mm_sub_epi16(full, aLo)), _mm_mullo_epi16(src, aLo)), 8);
+            dHi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(dHi, _mm_sub_epi16(full, aHi)), _mm_mullo_epi16(src, aHi)), 8);
+            _mm_storeu_si128((__m128i*)p, _mm_packus_epi16(dLo, dHi));
+        }
+#endif
+        for (; x < right; x++, p += 4) {
+            float vx = x + 0.5f - x0;
+            float t = (vx * dx + vy * dy) * invLen2;
+            if (t < 0) t = 0;
+            if (t > 1) t = 1;
+            float ex = vx - t * dx;
+            float ey = vy - t * dy;
+            float cover = reach - sqrtf(ex * ex + ey * ey);
+            if (cover <= 0) continue;
+            if (cover > 1) cover = 1;
+            BlendPixel(p, bytes, (int)(cover * alphaScale + 0.5f));
+        }
+    }
+}
+
+void WinMTRRaster::DrawGlyph(unsigned char c, int x, int y, int scale, bool up, unsigned int color)
+{
+    if (c < 0x20 || c > 0x7E) c = '?';
+    const unsigned char* glyph = Font5x7[c - 0x20];
+    for (int col = 0; col < 5; col++) {
+        for (int row = 0; row < GLYPH_HEIGHT; row++) {
+            if (!(glyph[col] & (1 << row))) continue;
+            if (up) FillRect(x + row * scale, y - (col + 1) * scale, scale, scale, color);
+            else FillRect(x + col * scale, y + row * scale, scale, scale, color);
+        }
+    }
+}
+
+void WinMTRRaster::DrawString(const char* text, float x, float y, float width, float height,
+                              int size, int align, int valign, unsigned int color)
+{
+    int scale = FontScale(size);
+    int textWidth = (int)strlen(text) * GLYPH_ADVANCE * scale - scale;
+    int textHeight = GLYPH_HEIGHT * scale;
+
+    float left = x;
+    if (align == CANVAS_ALIGN_CENTER) left = x + (width - textWidth) / 2;
+    else if (align == CANVAS_ALIGN_FAR) left = x + width - textWidth;
+    float top = y;
+    if (valign == CANVAS_ALIGN_CENTER) top = y + (height - textHeight) / 2;
+    else if (valign == CANVAS_ALIGN_FAR) top = y + height - textHeight;
+
+    int px = (int)floorf(left + 0.5f);
+    int py = (int)floorf(top + 0.5f);
+    for (const char* c = text; *c; c++, px += GLYPH_ADVANCE * scale) {
+        if (px >= m_clipRight) break;
+        DrawGlyph((unsigned char)*c, px, py, scale, false, color);
+    }
+}
+
+void WinMTRRaster::DrawStringUp(const char* text, float x, float y, int size, unsigned int color)
+{
+    int scale = FontScale(size);
+    int textWidth = (int)strlen(text) * GLYPH_ADVANCE * scale - scale;
+
+    int px = (int)floorf(x + 0.5f);
+    int py = (int)floorf(y + textWidth / 2.0f + 0.5f);
+    for (const char* c = text; *c; c++, py -= GLYPH_ADVANCE * scale) {
+        DrawGlyph((unsigned char)*c, px, py, scale, true, color);
+    }
+}
+
+//*****************************************************************************
+// PNG encoder
+//
+// Every row is stored with the Up filter, rows that repeat the one above
+// become zeros. The zlib stream is a single deflate block with the fixed
+// Huffman codes; matches are only looked for one pixel and one row back,
+// which is where a graph repeats itself.
+//*****************************************************************************
+
+struct s_bitwriter {
+    std::vector<unsigned char>& out;
+    unsigned int bits;
+    int count;
+
+    s_bitwriter(std::vector<unsigned char>& o) : out(o), bits(0), count(0) {}
+
+    // value LSB first, as deflate wants extra bits and headers
+    void Put(unsigned int value, int n) {
+        bits |= value << count;
+        count += n;
+        while (count >= 8) {
+            out.push_back((unsigned char)bits);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+    // Huffman codes go MSB first
+    void PutCode(unsigned int code, int n) {
+        unsigned int reversed = 0;
+        for (int i = 0; i < n; i++) reversed |= ((code >> i) & 1) << (n - 1 - i);
+        Put(reversed, n);
+    }
+    void Flush() {
+        if (count > 0) out.push_back((unsigned char)bits);
+        bits = 0;
+        count = 0;
+    }
+};
+
+static const unsigned short LengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char LengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short DistBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char DistExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void PutSymbol(s_bitwriter& w, int symbol)
+{
+    if (symbol < 144) w.PutCode(0x30 + symbol, 8);
+    else if (symbol < 256) w.PutCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280) w.PutCode(symbol - 256, 7);
+    else w.PutCode(0xC0 + symbol - 280, 8);
+}
+
+static void PutMatch(s_bitwriter& w, int length, int distance)
+{
+    int l = 28;
+    while (LengthBase[l] > length) l--;
+    PutSymbol(w, 257 + l);
+    if (LengthExtra[l]) w.Put(length - LengthBase[l], LengthExtra[l]);
+
+    int d = 29;
+    while (DistBase[d] > distance) d--;
+    w.PutCode(d, 5);
+    if (DistExtra[d]) w.Put(distance - DistBase[d], DistExtra[d]);
+}
+
+static void Deflate(const std::vector<unsigned char>& data, int rowBytes, std::vector<unsigned char>& out)
+{
+    s_bitwriter w(out);
+    w.Put(1, 1);    // final block
+    w.Put(1, 2);    // fixed Huffman codes
+
+    int distances[2] = { 4, rowBytes <= 32768 ? rowBytes : 0 };
+    size_t n = data.size();
+    size_t i = 0;
+    while (i < n) {
+        int bestLength = 0, bestDistance = 0;
+        for (int k = 0; k < 2; k++) {
+            size_t d = distances[k];
+            if (d == 0 || i < d) continue;
+            size_t length = 0;
+            while (length < 258 && i + length < n && data[i + length] == data[i + length - d]) length++;
+            if ((int)length > bestLength) {
+                bestLength = (int)length;
+                bestDistance = (int)d;
+            }
+        }
+        if (bestLength >= 3) {
+            PutMatch(w, bestLength, bestDistance);
+            i += bestLength;
+        } else {
+            PutSymbol(w, data[i]);
+            i++;
+        }
+    }
+    PutSymbol(w, 256);  // end of block
+    w.Flush();
+}
+
+struct s_crctable {
+    unsigned int entry[256];
+
+    s_crctable() {
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entry[n] = c;
+        }
+    }
+};
+
+static unsigned int Crc32(unsigned int crc, const unsigned char* data, size_t size)
+{
+    static const s_crctable table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table.entry[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static unsigned int Adler32(const unsigned char* data, size_t size)
+{
+    // 5552 bytes is the most that can be summed before b could overflow
+    unsigned int a = 1, b = 0;
+    while (size > 0) {
+        size_t block = size < 5552 ? size : 5552;
+        size -= block;
+        while (block--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void PutU32(std::vector<unsigned char>& out, unsigned int value)
+{
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+static void PutChunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data)
+{
+    PutU32(png, (unsigned int)data.size());
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    PutU32(png, Crc32(0, &png[start], png.size() - start));
+}
+
+void WinMTRRaster::EncodePNG(std::vector<unsigned char>& png) const
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    png.assign(signature, signature + 8);
+
+    std::vector<unsigned char> header;
+    PutU32(header, m_width);
+    PutU32(header, m_height);
+    header.push_back(8);    // bit depth
+    header.push_back(6);    // RGBA
+    header.push_back(0);    // deflate
+    header.push_back(0);    // adaptive filtering
+    header.push_back(0);    // no interlace
+    PutChunk(png, "IHDR", header);
+
+    // Up filter: every byte minus the one above it
+    size_t stride = (size_t)m_width * 4;
+    int rowBytes = (int)stride + 1;
+    std::vector<unsigned char> filtered((size_t)rowBytes * m_height);
+    for (int row = 0; row < m_height; row++) {
+        unsigned char* out = &filtered[(size_t)row * rowBytes];
+        const unsigned char* cur = &m_pixels[row * stride];
+        *out++ = 2;
+        if (row == 0) {
+            memcpy(out, cur, stride);
+        } else {
+            const unsigned char* above = cur - stride;
+            for (size_t i = 0; i < stride; i++) out[i] = (unsigned char)(cur[i] - above[i]);
+        }
+    }
+
+    std::vector<unsigned char> zlib;
+    zlib.push_back(0x78);   // deflate, 32K window
+    zlib.push_back(0x01);
+    Deflate(filtered, rowBytes, zlib);
+
+    PutU32(zlib, Adler32(filtered.empty() ? NULL : &filtered[0], filtered.size()));
+    PutChunk(png, "IDAT", zlib);
+
+    PutChunk(png, "IEND", std::vector<unsigned char>());
+}
+
+bool WinMTRRaster::WritePNG(FILE* file) const
+{
+    std::vector<unsigned char> png;
+    EncodePNG(png);
+    return fwrite(&png[0], 1, png.size(), file) == png.size();
+}
@@ -0,0 +1,62 @@
+//*****************************************************************************
+// FILE:            WinMTRRaster.h
+//
+// DESCRIPTION:     Software WinMTRCanvas drawing into an in-memory RGBA
+//                  framebuffer, with antialiased lines, a baked 5x7 bitmap
+//                  font and a built-in PNG encoder. Needs no window, display
+//                  or graphics library.
+//
+//*****************************************************************************
+
+#ifndef WINMTRRASTER_H_
+#define WINMTRRASTER_H_
+
+#include <stdio.h>
+#include <vector>
+#include "WinMTRCanvas.h"
+
+//*****************************************************************************
+// CLASS:  WinMTRRaster
+//
+// Pixels are 4 bytes R, G, B, A, rows top down without padding. The image
+// starts out opaque black. Lines are blended by their coverage of each pixel,
+// the coverage of four pixels at a time with SSE2 where available.
+//*****************************************************************************
+class WinMTRRaster : public WinMTRCanvas
+{
+public:
+    WinMTRRaster(int width, int height);
+
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    const unsigned char* Pixels() const { return m_pixels.empty() ? NULL : &m_pixels[0]; }
+
+    virtual void FillRect(int x, int y, int width, int height, unsigned int color);
+    virtual void DrawLine(float x0, float y0, float x1, float y1, float width, unsigned int color);
+    virtual void DrawLines(const s_canvaspoint* points, int count, float width, unsigned int color);
+    virtual void DrawString(const char* text, float x, float y, float width, float height,
+                            int size, int align, int valign, unsigned int color);
+    virtual void DrawStringUp(const char* text, float x, float y, int size, unsigned int color);
+    virtual void SetClip(int x, int y, int width, int height);
+    virtual void ResetClip();
+
+    // The image as a PNG file
+    void EncodePNG(std::vector<unsigned char>& png) const;
+    bool WritePNG(FILE* file) const;
+
+private:
+    void DrawSegment(float x0, float y0, float x1, float y1, float radius, unsigned int color);
+    void DrawGlyph(unsigned char c, int x, int y, int scale, bool up, unsigned int color);
+
+    int m_width;
+    int m_height;
+    std::vector<unsigned char> m_pixels;
+
+    // clip rectangle, right and bottom exclusive
+    int m_clipLeft;
+    int m_clipTop;
+    int m_clipRight;
+    int m_clipBottom;
+};
+
+#endif // WINMTRRASTER_H_
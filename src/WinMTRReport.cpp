@@ -0,0 +1,159 @@
+//*****************************************************************************
+// FILE:            WinMTRReport.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRReport.h"
+#include "WinMTRResolver.h"
+#include "WinMTRPlot.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define PLOT_SAMPLE_PERIOD 1000	// ms, the graph takes one sample per second
+
+// the sampler of RunReport, beside DoTrace on the calling thread
+struct s_plotsampler {
+	WinMTRNet*				net;
+	WinMTRPlot*				plot;
+	std::mutex				lock;
+	std::condition_variable	stopped;
+	bool					done;
+};
+
+//*****************************************************************************
+// FormatRTT
+//
+// Four significant digits are about what the clocks resolve, more would only
+// widen the columns.
+//*****************************************************************************
+void FormatRTT(char* buf, size_t size, int micros)
+{
+	double ms = micros / 1000.0;
+	snprintf(buf, size, ms < 10 ? "%.3f" : ms < 100 ? "%.2f" : "%.1f", ms);
+}
+
+// one line of the table
+static void FormatHop(const s_hopsnapshot& hop, const char* name, std::string& out)
+{
+	char t_buf[1000];
+	char best[16], avg[16], worst[16], last[16], stdev[16], p95[16], p99[16], jitter[16];
+	FormatRTT(best, sizeof(best), hop.best);
+	FormatRTT(avg, sizeof(avg), hop.avg);
+	FormatRTT(worst, sizeof(worst), hop.worst);
+	FormatRTT(last, sizeof(last), hop.last);
+	FormatRTT(stdev, sizeof(stdev), hop.stdev);
+	FormatRTT(p95, sizeof(p95), hop.p95);
+	FormatRTT(p99, sizeof(p99), hop.p99);
+	FormatRTT(jitter, sizeof(jitter), hop.jitter);
+	snprintf(t_buf, sizeof(t_buf), "|%40s - %4d | %4d | %4d | %6s | %6s | %6s | %6s | %6s | %6s | %6s | %6s |\r\n" ,
+			 name, hop.percent,
+			 hop.xmit, hop.returned, best,
+			 avg, worst, last,
+			 stdev, p95, p99, jitter);
+	out += t_buf;
+}
+
+//*****************************************************************************
+// FormatReport
+//
+// The name of a responder is marked with a leading +.
+//*****************************************************************************
+void FormatReport(const s_pathsnapshot* path, std::string& out, const s_pathresponders* responders)
+{
+	char name[300];
+	
+	out  = "|--------------------------------------------------------------------------------------------------------------------------------------|\r\n";
+	out += "|                                                           WinMTR statistics                                                          |\r\n";
+	out += "|                       Host              -   %  | Sent | Recv |  Best  |  Avrg  |  Wrst  |  Last  |  StDev |   95%  |   99%  | Jitter |\r\n";
+	out += "|------------------------------------------------|------|------|--------|--------|--------|--------|--------|--------|--------|--------|\r\n";
+	
+	for(int i=0; i <path->count ; i++) {
+		const s_hopsnapshot& hop = path->hop[i];
+		FormatHop(hop, hop.name[0] ? hop.name : "No response from host", out);
+		if(!responders || responders->count[i] < 2)
+			continue;
+		for(int r=0; r<responders->count[i]; ++r) {
+			snprintf(name, sizeof(name), "+ %s", responders->responder[i][r].name);
+			FormatHop(responders->responder[i][r], name, out);
+		}
+	}
+	
+	out += "|________________________________________________|______|______|________|________|________|________|________|________|________|________|\r\n";
+}
+
+//*****************************************************************************
+// AddPlotSample
+//
+// The last RTT of every hop, named if it ever answered, like the dialog
+// feeds its graph.
+//*****************************************************************************
+static void AddPlotSample(WinMTRNet* net, WinMTRPlot* plot)
+{
+	s_pathsnapshot path;
+	int rtt[MAX_GRAPH_HOPS];
+	const char* hostnames[MAX_GRAPH_HOPS];
+	net->Snapshot(&path);
+	int count = path.count < MAX_GRAPH_HOPS ? path.count : MAX_GRAPH_HOPS;
+	for(int i=0; i<count; ++i) {
+		rtt[i] = path.hop[i].last;
+		hostnames[i] = path.hop[i].percent < 100 ? path.hop[i].name : "";
+	}
+	plot->AddSample(GetTimeMicros() / 1000, rtt, hostnames, count);
+}
+
+static void PlotSampler(s_plotsampler* sampler)
+{
+	std::unique_lock<std::mutex> guard(sampler->lock);
+	while(!sampler->done) {
+		if(sampler->stopped.wait_for(guard, std::chrono::milliseconds(PLOT_SAMPLE_PERIOD)) == std::cv_status::timeout && !sampler->done)
+			AddPlotSample(sampler->net, sampler->plot);
+	}
+}
+
+//*****************************************************************************
+// RunReport
+//
+// Runs the trace on the calling thread, DoTrace returns by itself once
+// every hop got its probes. The plot is sampled from a thread of its own
+// meanwhile, Snapshot() is safe there, and once more at the end.
+//*****************************************************************************
+bool RunReport(WinMTRNet* net, const char* hostname, int family, std::string& out, WinMTRPlot* plot)
+{
+	if(!net->initialized) {
+		out = "Unable to initialize the probe backend: " + net->error + "\r\n";
+		return false;
+	}
+	
+	std::vector<sockaddr_in6> addrs;
+	if(!WinMTRResolver::HostAddrs(hostname, net->hasIPv6 ? family : AF_INET, addrs)) {
+		out = "Unable to resolve hostname.\r\n";
+		return false;
+	}
+	if(plot) {
+		s_plotsampler sampler;
+		sampler.net = net;
+		sampler.plot = plot;
+		sampler.done = false;
+		std::thread thread(PlotSampler, &sampler);
+		net->DoTrace((sockaddr*)&addrs[0]);
+		{
+			std::lock_guard<std::mutex> guard(sampler.lock);
+			sampler.done = true;
+		}
+		sampler.stopped.notify_one();
+		thread.join();
+		AddPlotSample(net, plot);
+	} else
+		net->DoTrace((sockaddr*)&addrs[0]); //we use first address returned
+	
+	s_pathsnapshot path;
+	s_pathresponders* responders = new s_pathresponders;
+	net->Snapshot(&path);
+	net->SnapshotResponders(responders);
+	FormatReport(&path, out, responders);
+	delete responders;
+	return true;
+}
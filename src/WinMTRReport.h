@@ -0,0 +1,29 @@
+//*****************************************************************************
+// FILE:            WinMTRReport.h
+//
+// DESCRIPTION:     Text report of a trace, as copied and exported by the
+//                  dialog and printed by the headless --report mode
+//
+//*****************************************************************************
+
+#ifndef WINMTRREPORT_H_
+#define WINMTRREPORT_H_
+
+#include "WinMTRNet.h"
+#include <string>
+
+class WinMTRPlot;
+
+// A time in us as ms with a fraction, the way the tables show it
+void FormatRTT(char* buf, size_t size, int micros);
+
+// The statistics table, lines end in \r\n. With responders every hop that
+// has more than one is followed by a line for each of them
+void FormatReport(const s_pathsnapshot* path, std::string& out, const s_pathresponders* responders = NULL);
+
+// Resolve hostname, trace it until every hop got net->count probes and
+// format the table into out. On failure out holds the error instead. With a
+// plot the last RTT of every hop is added to it once a second meanwhile
+bool RunReport(WinMTRNet* net, const char* hostname, int family, std::string& out, WinMTRPlot* plot = NULL);
+
+#endif // ifndef WINMTRREPORT_H_
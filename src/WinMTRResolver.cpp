@@ -0,0 +1,331 @@
+//*****************************************************************************
+// FILE:            WinMTRResolver.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRResolver.h"
+#include <algorithm>
+
+WinMTRResolver& WinMTRResolver::Shared()
+{
+	// not destroyed at exit, the workers may still be blocked in getnameinfo()
+	static WinMTRResolver* resolver = new WinMTRResolver;
+	return *resolver;
+}
+
+WinMTRResolver::WinMTRResolver()
+{
+	char filename[1024];
+	if(WinMTRDnsCache::DefaultPath(filename, sizeof(filename)))
+		file.Open(filename);
+}
+
+//*****************************************************************************
+// WinMTRResolver::Resolve
+//
+// Cache hits are answered right away, an expired entry is looked up again.
+// The workers are started with the first lookup.
+//*****************************************************************************
+bool WinMTRResolver::Resolve(const sockaddr* addr, char* name, ResolverProc proc, void* owner, int index)
+{
+	s_dnskey key = MakeKey(addr);
+	std::lock_guard<std::mutex> guard(lock);
+	if(Find(key, name))
+		return true;
+	s_dnswaiter waiter = {proc, owner, index};
+	auto request = pending.find(key);
+	if(request != pending.end()) {
+		request->second.push_back(waiter);
+		return false;
+	}
+	pending[key].push_back(waiter);
+	queue.push_back(key);
+	StartWorkers();
+	queued.notify_one();
+	return false;
+}
+
+//*****************************************************************************
+// WinMTRResolver::ResolveHost
+//
+// Like Resolve(), for the addresses of a host name or a numeric address.
+//*****************************************************************************
+bool WinMTRResolver::ResolveHost(const char* host, int family, std::vector<sockaddr_in6>& addrs, HostProc proc, void* owner)
+{
+	std::string key = HostKey(host, family);
+	std::lock_guard<std::mutex> guard(lock);
+	auto hit = hosts.find(key);
+	if(hit != hosts.end()) {
+		if(hit->second.expires > GetTickCount64()) {
+			addrs = hit->second.addrs;
+			return true;
+		}
+		hosts.erase(hit);
+	}
+	s_hostwaiter waiter = {proc, owner};
+	auto request = pendingHosts.find(key);
+	if(request != pendingHosts.end()) {
+		request->second.push_back(waiter);
+		return false;
+	}
+	pendingHosts[key].push_back(waiter);
+	s_hostquery query;
+	query.host = host;
+	query.family = family;
+	hostQueue.push_back(query);
+	StartWorkers();
+	queued.notify_one();
+	return false;
+}
+
+bool WinMTRResolver::Lookup(const sockaddr* addr, char* name)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return Find(MakeKey(addr), name);
+}
+
+//*****************************************************************************
+// WinMTRResolver::Find
+//
+// Looks in the cache of this session first, then in the file. An entry
+// found in the file keeps the time it had left.
+//*****************************************************************************
+bool WinMTRResolver::Find(const s_dnskey& key, char* name)
+{
+	auto hit = cache.find(key);
+	if(hit != cache.end()) {
+		if(hit->second->expires > GetTickCount64()) {
+			lru.splice(lru.begin(), lru, hit->second);
+			strcpy(name, hit->second->name.c_str());
+			return true;
+		}
+		lru.erase(hit->second);
+		cache.erase(hit);
+	}
+	ULONGLONG seconds = file.Lookup(key, name);
+	if(!seconds)
+		return false;
+	Remember(key, name, seconds * 1000);
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRResolver::Cancel
+//
+// A lookup keeps running once started, only its callbacks for owner are
+// dropped. Must not be called from a callback.
+//*****************************************************************************
+void WinMTRResolver::Cancel(void* owner)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for(auto& request : pending) {
+		std::vector<s_dnswaiter>& waiters = request.second;
+		waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+									 [owner](const s_dnswaiter& w) { return w.owner == owner; }),
+					  waiters.end());
+	}
+	for(auto& request : pendingHosts) {
+		std::vector<s_hostwaiter>& waiters = request.second;
+		waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+									 [owner](const s_hostwaiter& w) { return w.owner == owner; }),
+					  waiters.end());
+	}
+	called.wait(guard, [this, owner] { return std::find(calling.begin(), calling.end(), owner) == calling.end(); });
+}
+
+// the workers are started with the first lookup, called under the lock
+void WinMTRResolver::StartWorkers()
+{
+	if(workers.empty())
+		for(int i=0; i<RESOLVER_THREADS; ++i)
+			workers.push_back(std::thread(&WinMTRResolver::Worker, this));
+}
+
+//*****************************************************************************
+// WinMTRResolver::Worker
+//
+//
+//*****************************************************************************
+void WinMTRResolver::Worker()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;) {
+		queued.wait(guard, [this] { return !queue.empty() || !hostQueue.empty(); });
+		if(!hostQueue.empty()) {
+			WorkHost(guard);
+			continue;
+		}
+		s_dnskey key = queue.front();
+		queue.pop_front();
+		guard.unlock();
+
+		sockaddr_in6 addr;
+		MakeAddr(key, &addr);
+		char name[NI_MAXHOST];
+		socklen_t addrlen = key.family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+		if(getnameinfo((sockaddr*)&addr, addrlen, name, NI_MAXHOST, NULL, 0, NI_NAMEREQD))
+			*name = '\0';
+
+		guard.lock();
+		Store(key, name);
+		// one waiter at a time, so Cancel() can still take out the others
+		for(;;) {
+			auto request = pending.find(key);
+			if(request == pending.end())
+				break;
+			if(request->second.empty()) {
+				pending.erase(request);
+				break;
+			}
+			s_dnswaiter waiter = request->second.back();
+			request->second.pop_back();
+			calling.push_back(waiter.owner);
+			guard.unlock();
+			waiter.proc(waiter.owner, waiter.index, name);
+			guard.lock();
+			calling.erase(std::find(calling.begin(), calling.end(), waiter.owner));
+			called.notify_all();
+		}
+	}
+}
+
+//*****************************************************************************
+// WinMTRResolver::WorkHost
+//
+// Looks up the first target of hostQueue, entered and left with the lock
+// held.
+//*****************************************************************************
+void WinMTRResolver::WorkHost(std::unique_lock<std::mutex>& guard)
+{
+	s_hostquery query = hostQueue.front();
+	hostQueue.pop_front();
+	guard.unlock();
+
+	std::vector<sockaddr_in6> addrs;
+	HostAddrs(query.host.c_str(), query.family, addrs);
+
+	guard.lock();
+	std::string key = HostKey(query.host.c_str(), query.family);
+	if(!addrs.empty())
+		RememberHost(key, addrs);
+	for(;;) {
+		auto request = pendingHosts.find(key);
+		if(request == pendingHosts.end())
+			break;
+		if(request->second.empty()) {
+			pendingHosts.erase(request);
+			break;
+		}
+		s_hostwaiter waiter = request->second.back();
+		request->second.pop_back();
+		calling.push_back(waiter.owner);
+		guard.unlock();
+		waiter.proc(waiter.owner, addrs);
+		guard.lock();
+		calling.erase(std::find(calling.begin(), calling.end(), waiter.owner));
+		called.notify_all();
+	}
+}
+
+bool WinMTRResolver::HostAddrs(const char* host, int family, std::vector<sockaddr_in6>& addrs)
+{
+	addrinfo nfofilter= {};
+	addrinfo* anfo;
+	nfofilter.ai_family=family;
+	nfofilter.ai_socktype=SOCK_RAW;
+	nfofilter.ai_flags=AI_NUMERICSERV|AI_ADDRCONFIG;//|AI_V4MAPPED;
+	addrs.clear();
+	if(getaddrinfo(host,NULL,&nfofilter,&anfo))
+		return false;
+	for(addrinfo* info=anfo; info; info=info->ai_next) {
+		if(info->ai_family != AF_INET && info->ai_family != AF_INET6)
+			continue;
+		sockaddr_in6 addr;
+		memset(&addr, 0, sizeof(addr));
+		memcpy(&addr, info->ai_addr, info->ai_addrlen < sizeof(addr) ? info->ai_addrlen : sizeof(addr));
+		bool seen = false;
+		for(size_t i=0; i<addrs.size() && !seen; ++i)
+			seen = !memcmp(&addrs[i], &addr, sizeof(addr));
+		if(!seen)
+			addrs.push_back(addr);
+	}
+	freeaddrinfo(anfo);
+	return !addrs.empty();
+}
+
+// keeps the addresses of a target, making room from the entry that expires first
+void WinMTRResolver::RememberHost(const std::string& key, const std::vector<sockaddr_in6>& addrs)
+{
+	if(hosts.size() >= RESOLVER_HOST_CACHE && !hosts.count(key)) {
+		auto first = hosts.begin();
+		for(auto entry = hosts.begin(); entry != hosts.end(); ++entry)
+			if(entry->second.expires < first->second.expires)
+				first = entry;
+		hosts.erase(first);
+	}
+	s_hostentry& entry = hosts[key];
+	entry.addrs = addrs;
+	entry.expires = GetTickCount64() + RESOLVER_HOST_TTL;
+}
+
+std::string WinMTRResolver::HostKey(const char* host, int family)
+{
+	char prefix[16];
+	sprintf(prefix, "%d/", family);
+	return prefix + std::string(host);
+}
+
+// caches the result of a lookup in memory and in the file
+void WinMTRResolver::Store(const s_dnskey& key, const char* name)
+{
+	ULONGLONG ttl = *name ? RESOLVER_TTL : RESOLVER_NEGATIVE_TTL;
+	Remember(key, name, ttl);
+	file.Store(key, name, ttl / 1000);
+}
+
+// puts a name in front of the cache, dropping the least recently used entry when full
+void WinMTRResolver::Remember(const s_dnskey& key, const char* name, ULONGLONG ttl)
+{
+	auto old = cache.find(key);
+	if(old != cache.end()) {
+		lru.erase(old->second);
+		cache.erase(old);
+	}
+	if(cache.size() >= RESOLVER_CACHE_SIZE) {
+		cache.erase(lru.back().key);
+		lru.pop_back();
+	}
+	s_dnsentry entry;
+	entry.key = key;
+	entry.name = name;
+	entry.expires = GetTickCount64() + ttl;
+	lru.push_front(entry);
+	cache[key] = lru.begin();
+}
+
+s_dnskey WinMTRResolver::MakeKey(const sockaddr* addr)
+{
+	s_dnskey key;
+	memset(&key, 0, sizeof(key));
+	key.family = addr->sa_family;
+	if(addr->sa_family == AF_INET6)
+		key.addr = ((const sockaddr_in6*)addr)->sin6_addr;
+	else
+		memcpy(&key.addr, &((const sockaddr_in*)addr)->sin_addr, sizeof(in_addr));
+	return key;
+}
+
+void WinMTRResolver::MakeAddr(const s_dnskey& key, sockaddr_in6* addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	if(key.family == AF_INET6) {
+		addr->sin6_family = AF_INET6;
+		addr->sin6_addr = key.addr;
+	} else {
+		sockaddr_in* addr4 = (sockaddr_in*)addr;
+		addr4->sin_family = AF_INET;
+		memcpy(&addr4->sin_addr, &key.addr, sizeof(in_addr));
+	}
+}
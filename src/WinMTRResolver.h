@@ -0,0 +1,126 @@
+//*****************************************************************************
+// FILE:            WinMTRResolver.h
+//
+//
+// DESCRIPTION:
+//   Reverse DNS lookups of the hop addresses on a fixed pool of worker
+//   threads, with one LRU cache of the names shared by every trace. The
+//   addresses of a trace target are looked up on the same workers.
+//
+// NOTES:
+//   getnameinfo() doesn't tell the TTL of a record, names are kept for
+//   RESOLVER_TTL and addresses without one for RESOLVER_NEGATIVE_TTL. Both
+//   are also kept in WinMTRDnsCache for the next session. getaddrinfo()
+//   doesn't tell it either, the addresses of a target are kept for
+//   RESOLVER_HOST_TTL and a failure isn't cached.
+//
+//*****************************************************************************
+
+#ifndef WINMTRRESOLVER_H_
+#define WINMTRRESOLVER_H_
+
+#include "WinMTRDnsCache.h"
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define RESOLVER_THREADS		4
+#define RESOLVER_CACHE_SIZE		4096
+#define RESOLVER_TTL			3600000		// ms a name is cached
+#define RESOLVER_NEGATIVE_TTL	300000		// ms an address without a name is cached
+#define RESOLVER_HOST_TTL		60000		// ms the addresses of a target are cached
+#define RESOLVER_HOST_CACHE		64
+
+// called on a worker thread with the name of the address, "" if it has none
+typedef void (*ResolverProc)(void* owner, int index, const char* name);
+// called on a worker thread with the addresses of a host, none if it has none
+typedef void (*HostProc)(void* owner, const std::vector<sockaddr_in6>& addrs);
+
+//*****************************************************************************
+// CLASS:  WinMTRResolver
+//
+// Requests for an address that is already being looked up wait for the same
+// lookup. The callbacks run without any lock of the resolver held.
+//*****************************************************************************
+
+class WinMTRResolver
+{
+public:
+	// the resolver of the process, started on first use and never destroyed
+	static WinMTRResolver& Shared();
+
+	// returns true with the cached name in name (NI_MAXHOST, "" if the address
+	// has none), otherwise queues a lookup that ends in proc
+	bool	Resolve(const sockaddr* addr, char* name, ResolverProc proc, void* owner, int index);
+	// a cached name only, returns false if there is none
+	bool	Lookup(const sockaddr* addr, char* name);
+	// returns true with the cached addresses of host in addrs, otherwise queues
+	// a lookup that ends in proc; family as addrinfo::ai_family
+	bool	ResolveHost(const char* host, int family, std::vector<sockaddr_in6>& addrs, HostProc proc, void* owner);
+	// drops the lookups of owner and waits for its callbacks that are running
+	void	Cancel(void* owner);
+
+	// getaddrinfo() on the calling thread, the addresses in the order it gave
+	// them without duplicates; returns false if there are none
+	static bool	HostAddrs(const char* host, int family, std::vector<sockaddr_in6>& addrs);
+
+private:
+	WinMTRResolver();
+
+	struct s_dnswaiter {
+		ResolverProc	proc;
+		void*			owner;
+		int				index;
+	};
+	struct s_dnsentry {
+		s_dnskey		key;
+		std::string		name;
+		ULONGLONG		expires;
+	};
+	struct s_hostwaiter {
+		HostProc		proc;
+		void*			owner;
+	};
+	struct s_hostquery {
+		std::string		host;
+		int				family;
+	};
+	struct s_hostentry {
+		std::vector<sockaddr_in6>	addrs;
+		ULONGLONG		expires;
+	};
+
+	void	StartWorkers();
+	void	Worker();
+	void	WorkHost(std::unique_lock<std::mutex>& guard);
+	void	RememberHost(const std::string& key, const std::vector<sockaddr_in6>& addrs);
+	static std::string	HostKey(const char* host, int family);
+	bool	Find(const s_dnskey& key, char* name);
+	void	Store(const s_dnskey& key, const char* name);
+	void	Remember(const s_dnskey& key, const char* name, ULONGLONG ttl);
+	static s_dnskey	MakeKey(const sockaddr* addr);
+	static void		MakeAddr(const s_dnskey& key, sockaddr_in6* addr);
+
+	std::mutex					lock;
+	std::condition_variable		queued;
+	std::condition_variable		called;		// a callback returned
+	std::vector<std::thread>	workers;
+	std::list<s_dnskey>			queue;
+	std::unordered_map<s_dnskey, std::vector<s_dnswaiter>, s_dnskeyhash>	pending;
+	std::vector<void*>			calling;	// owners of the callbacks running
+	std::list<s_hostquery>		hostQueue;	// before queue, someone waits for a target
+	std::unordered_map<std::string, std::vector<s_hostwaiter>>	pendingHosts;
+
+	// the cache, most recently used first
+	std::list<s_dnsentry>		lru;
+	std::unordered_map<s_dnskey, std::list<s_dnsentry>::iterator, s_dnskeyhash>	cache;
+	WinMTRDnsCache				file;		// behind cache, of this and earlier sessions
+	std::unordered_map<std::string, s_hostentry>	hosts;
+};
+
+#endif	// ifndef WINMTRRESOLVER_H_
@@ -0,0 +1,74 @@
+//*****************************************************************************
+// FILE:            WinMTRStats.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRStats.h"
+#include <math.h>
+
+// bucket of an RTT: the first RTT_SUB_COUNT us one each, above that the
+// upper half of the sub-buckets of every power of two
+static int RttBucket(int rtt)
+{
+	if(rtt < RTT_SUB_COUNT)
+		return rtt < 0 ? 0 : rtt;
+	if(rtt >= (1 << RTT_MAX_BITS))
+		return RTT_BUCKETS - 1;
+	int bits = 0;
+	while(rtt >> (bits + 1)) ++bits;
+	int shift = bits - (RTT_SUB_BITS - 1);
+	return RTT_SUB_COUNT + (shift - 1) * (RTT_SUB_COUNT / 2) + (rtt >> shift) - RTT_SUB_COUNT / 2;
+}
+
+// middle of the RTTs of a bucket
+static int RttBucketValue(int bucket)
+{
+	if(bucket < RTT_SUB_COUNT)
+		return bucket;
+	int shift = (bucket - RTT_SUB_COUNT) / (RTT_SUB_COUNT / 2) + 1;
+	int sub = (bucket - RTT_SUB_COUNT) % (RTT_SUB_COUNT / 2) + RTT_SUB_COUNT / 2;
+	return (sub << shift) + (1 << (shift - 1));
+}
+
+//*****************************************************************************
+// RttStatsAdd
+//
+// The jitter is that of RFC 3550 section 6.4.1 with the difference of two
+// round trip times in place of the transit times, kept scaled by 16 like in
+// its appendix A.8.
+//*****************************************************************************
+void RttStatsAdd(s_rttstats& stats, int rtt, int previous, int count)
+{
+	++stats.histogram[RttBucket(rtt)];
+
+	double delta = rtt - stats.mean;
+	stats.mean += delta / count;
+	stats.m2 += delta * (rtt - stats.mean);
+
+	if(previous >= 0) {
+		int d = rtt > previous ? rtt - previous : previous - rtt;
+		stats.jitter += d - ((stats.jitter + 8) >> 4);
+	}
+}
+
+int RttPercentile(const s_rttstats& stats, int count, double percent)
+{
+	if(count <= 0)
+		return 0;
+	ULONGLONG rank = (ULONGLONG)ceil(count * percent / 100);
+	if(rank < 1) rank = 1;
+	ULONGLONG seen = 0;
+	for(int i=0; i<RTT_BUCKETS; ++i) {
+		seen += stats.histogram[i];
+		if(seen >= rank)
+			return RttBucketValue(i);
+	}
+	return RttBucketValue(RTT_BUCKETS - 1);
+}
+
+int RttStdDev(const s_rttstats& stats, int count)
+{
+	return count > 1 ? (int)(sqrt(stats.m2 / (count - 1)) + 0.5) : 0;
+}
@@ -0,0 +1,42 @@
+//*****************************************************************************
+// FILE:            WinMTRStats.h
+//
+//
+// DESCRIPTION:
+//   Streaming RTT statistics of one hop: a log-linear histogram for the
+//   percentiles, Welford's running variance and the RFC 3550 interarrival
+//   jitter. Memory and the cost of a sample stay the same however long a
+//   trace runs.
+//
+// NOTES:
+//   The histogram has RTT_SUB_COUNT linear buckets per power of two (like an
+//   HDR histogram with RTT_SUB_BITS of precision), so a percentile is within
+//   about 3% of the true value.
+//
+//*****************************************************************************
+
+#ifndef WINMTRSTATS_H_
+#define WINMTRSTATS_H_
+
+#define RTT_SUB_BITS	5
+#define RTT_SUB_COUNT	(1 << RTT_SUB_BITS)
+#define RTT_MAX_BITS	23		// 8.3 s in us, more than ECHO_REPLY_TIMEOUT
+#define RTT_BUCKETS		(RTT_SUB_COUNT + (RTT_MAX_BITS - RTT_SUB_BITS) * RTT_SUB_COUNT / 2)
+
+struct s_rttstats {
+	unsigned int	histogram[RTT_BUCKETS];	// replies per RTT bucket
+	double			mean;		// us, Welford
+	double			m2;			// sum of squared differences from the mean
+	int				jitter;		// RFC 3550 interarrival jitter in 1/16 us
+};
+
+// adds the RTT of a reply, previous is the RTT of the reply before or -1 and
+// count the number of replies including this one
+void	RttStatsAdd(s_rttstats& stats, int rtt, int previous, int count);
+// the RTT in us that percent of the count replies are at or below
+int		RttPercentile(const s_rttstats& stats, int count, double percent);
+// sample standard deviation in us
+int		RttStdDev(const s_rttstats& stats, int count);
+inline int RttJitter(const s_rttstats& stats) { return (stats.jitter + 8) >> 4; }
+
+#endif	// ifndef WINMTRSTATS_H_
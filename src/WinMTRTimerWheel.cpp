@@ -0,0 +1,192 @@
+//*****************************************************************************
+// FILE:            WinMTRTimerWheel.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRTimerWheel.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, word is not 0
+static inline int LowestBit(ULONGLONG word)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	if(_BitScanForward(&index, (unsigned long)word))
+		return (int)index;
+	_BitScanForward(&index, (unsigned long)(word >> 32));
+	return (int)index + 32;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+WinMTRTimerWheel::WinMTRTimerWheel()
+{
+	Start(0);
+}
+
+void WinMTRTimerWheel::Start(ULONGLONG now)
+{
+	memset(buckets,0,sizeof(buckets));
+	memset(occupied,0,sizeof(occupied));
+	current = now;
+}
+
+//*****************************************************************************
+// WinMTRTimerWheel::Add
+//
+// The level is chosen by how far the timer is ahead of the wheel, the slot
+// by the bits of its expiry time that belong to that level.
+//*****************************************************************************
+void WinMTRTimerWheel::Add(s_timer* timer, ULONGLONG expires)
+{
+	if(timer->pprev)
+		Remove(timer);
+	timer->expires = expires;
+	if(expires < current) {
+		Link(timer, WHEEL_DUE);
+		return;
+	}
+	ULONGLONG delta = expires - current;
+	int level = 0;
+	while(level < WHEEL_LEVELS - 1 && delta >= ((ULONGLONG)1 << (WHEEL_BITS * (level + 1))))
+		++level;
+	if(delta >> (WHEEL_BITS * WHEEL_LEVELS))
+		expires = current + ((ULONGLONG)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;// out of range, comes back when the last level cascades
+	int slot = (int)(expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	Link(timer, level * WHEEL_SIZE + slot);
+}
+
+void WinMTRTimerWheel::Link(s_timer* timer, int bucket)
+{
+	timer->bucket = bucket;
+	timer->next = buckets[bucket];
+	if(timer->next) timer->next->pprev = &timer->next;
+	timer->pprev = &buckets[bucket];
+	buckets[bucket] = timer;
+	if(bucket < WHEEL_DUE)
+		occupied[bucket / WHEEL_SIZE][(bucket & WHEEL_MASK) / 64] |= (ULONGLONG)1 << (bucket & 63);
+}
+
+void WinMTRTimerWheel::Remove(s_timer* timer)
+{
+	if(!timer->pprev)
+		return;
+	*timer->pprev = timer->next;
+	if(timer->next) timer->next->pprev = timer->pprev;
+	timer->pprev = NULL;
+	int bucket = timer->bucket;
+	if(bucket < WHEEL_DUE && !buckets[bucket])
+		occupied[bucket / WHEEL_SIZE][(bucket & WHEEL_MASK) / 64] &= ~((ULONGLONG)1 << (bucket & 63));
+}
+
+//*****************************************************************************
+// WinMTRTimerWheel::Expired
+//
+//
+//*****************************************************************************
+s_timer* WinMTRTimerWheel::Expired(ULONGLONG now)
+{
+	if(!buckets[WHEEL_DUE])
+		Advance(now);
+	s_timer* timer = buckets[WHEEL_DUE];
+	if(timer)
+		Remove(timer);
+	return timer;
+}
+
+//*****************************************************************************
+// WinMTRTimerWheel::Advance
+//
+// Moves the timers of every tick up to now to the due bucket. Empty slots of
+// the first level are skipped with its bitmap, so an idle wheel costs one
+// step per 256 ms.
+//*****************************************************************************
+void WinMTRTimerWheel::Advance(ULONGLONG now)
+{
+	while(current <= now) {
+		int index = (int)(current & WHEEL_MASK);
+		if(!index)
+			Cascade(current);
+		int slot = FindSlot(0, index);
+		if(slot == WHEEL_SIZE) {
+			ULONGLONG boundary = (current | WHEEL_MASK) + 1;
+			current = boundary <= now ? boundary : now + 1;
+			continue;
+		}
+		ULONGLONG tick = current - index + slot;
+		if(tick > now) {
+			current = now + 1;
+			break;
+		}
+		while(s_timer* timer = buckets[slot]) {
+			Remove(timer);
+			Link(timer, WHEEL_DUE);
+		}
+		current = tick + 1;
+	}
+}
+
+//*****************************************************************************
+// WinMTRTimerWheel::Cascade
+//
+// At the start of each round of a level, the timers of the next slot of the
+// level above are spread over it.
+//*****************************************************************************
+void WinMTRTimerWheel::Cascade(ULONGLONG tick)
+{
+	for(int level=1; level<WHEEL_LEVELS; ++level) {
+		int slot = (int)(tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+		int bucket = level * WHEEL_SIZE + slot;
+		s_timer* timer = buckets[bucket];
+		buckets[bucket] = NULL;
+		occupied[level][slot / 64] &= ~((ULONGLONG)1 << (slot & 63));
+		while(timer) {
+			s_timer* next = timer->next;
+			timer->pprev = NULL;
+			Add(timer, timer->expires);
+			timer = next;
+		}
+		if(slot)
+			break;
+	}
+}
+
+// first non-empty slot of level at or after from, WHEEL_SIZE if none
+int WinMTRTimerWheel::FindSlot(int level, int from) const
+{
+	for(int word = from / 64; word < WHEEL_SIZE / 64; ++word) {
+		ULONGLONG bits = occupied[level][word];
+		if(word == from / 64)
+			bits &= ~(ULONGLONG)0 << (from & 63);
+		if(bits)
+			return word * 64 + LowestBit(bits);
+	}
+	return WHEEL_SIZE;
+}
+
+//*****************************************************************************
+// WinMTRTimerWheel::NextTimeout
+//
+// Exact for timers in the first level. Later ones can't expire before the
+// first level wraps around, so that is when to look again.
+//*****************************************************************************
+DWORD WinMTRTimerWheel::NextTimeout(ULONGLONG now, DWORD limit)
+{
+	if(buckets[WHEEL_DUE] || current <= now)
+		return 0;
+	int index = (int)(current & WHEEL_MASK);
+	ULONGLONG next = current;// at the start of a round the cascade is still to come
+	if(index) {
+		int slot = FindSlot(0, index);
+		next = slot < WHEEL_SIZE ? current - index + slot : (current | WHEEL_MASK) + 1;
+	}
+	if(next - now < limit)
+		limit = (DWORD)(next - now);
+	return limit;
+}
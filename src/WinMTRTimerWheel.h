@@ -0,0 +1,100 @@
+//*****************************************************************************
+// FILE:            WinMTRTimerWheel.h
+//
+//
+// DESCRIPTION:
+//   Hierarchical timing wheel holding the probe timeouts and send times of
+//   the probe loops. Adding, removing and expiring a timer is O(1), however
+//   many probe streams there are.
+//
+// NOTES:
+//   Four levels of 256 slots with a resolution of 1 ms cover 2^32 ms, later
+//   timers wait in the last level until they come into range.
+//
+//*****************************************************************************
+
+#ifndef WINMTRTIMERWHEEL_H_
+#define WINMTRTIMERWHEEL_H_
+
+#define WHEEL_BITS		8
+#define WHEEL_SIZE		(1 << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+#define WHEEL_DUE		(WHEEL_LEVELS * WHEEL_SIZE)	// bucket of the expired timers
+
+// a timer, embedded in what it times; type and index are up to the owner
+struct s_timer {
+	s_timer*		next;
+	s_timer**		pprev;		// the pointer to this timer, NULL while not added
+	ULONGLONG		expires;	// ms, on the clock passed to the wheel
+	int				bucket;
+	int				type;
+	int				index;
+};
+
+// send times of one probe stream, slot n is due at start + n * period (us)
+struct s_pacing {
+	ULONGLONG		start;
+	ULONGLONG		period;
+	ULONGLONG		slot;		// next slot to send in
+};
+
+inline ULONGLONG PacingDeadline(const s_pacing& pacing)
+{
+	return pacing.start + pacing.slot * pacing.period;
+}
+
+// Moves on to the next slot after sending at now. A probe less than a period
+// late keeps its slot, so the following ones are on time again; slots missed
+// entirely are skipped instead of sent in a burst. Returns how many were.
+inline ULONGLONG PacingAdvance(s_pacing& pacing, ULONGLONG now)
+{
+	ULONGLONG deadline = PacingDeadline(pacing);
+	ULONGLONG skipped = now > deadline ? (now - deadline) / pacing.period : 0;
+	pacing.slot += skipped + 1;
+	return skipped;
+}
+
+// wheel tick of a time in us, rounded up so a timer never fires early
+inline ULONGLONG WheelTick(ULONGLONG micros)
+{
+	return (micros + 999) / 1000;
+}
+
+//*****************************************************************************
+// CLASS:  WinMTRTimerWheel
+//
+// Timers expire in order of their slot, timers of the same millisecond in no
+// particular order. Expired() keeps returning the timers due until there are
+// none left, a timer added again from there expires in the same call if it
+// is already due.
+//*****************************************************************************
+
+class WinMTRTimerWheel
+{
+public:
+	WinMTRTimerWheel();
+
+	// forgets all timers and starts the wheel at now
+	void		Start(ULONGLONG now);
+	void		Add(s_timer* timer, ULONGLONG expires);
+	void		Remove(s_timer* timer);
+	static bool	Pending(const s_timer* timer) { return timer->pprev != NULL; }
+
+	// the next timer due at now, NULL when there is none
+	s_timer*	Expired(ULONGLONG now);
+	// ms from now until the next timer may be due, at most limit
+	DWORD		NextTimeout(ULONGLONG now, DWORD limit);
+
+private:
+	void		Advance(ULONGLONG now);
+	void		Cascade(ULONGLONG tick);
+	void		Link(s_timer* timer, int bucket);
+	int			FindSlot(int level, int from) const;
+
+	s_timer*	buckets[WHEEL_DUE + 1];
+	ULONGLONG	occupied[WHEEL_LEVELS][WHEEL_SIZE / 64];	// bit per non-empty slot
+	ULONGLONG	current;	// next tick to process, all earlier ones are
+};
+
+#endif	// ifndef WINMTRTIMERWHEEL_H_
@@ -0,0 +1,169 @@
+//*****************************************************************************
+// FILE:            WinMTRRenderTest.cpp
+//
+//
+// DESCRIPTION:
+//   Render test of the console build: a few pixels drawn by WinMTRRaster and
+//   WinMTRPlot, and the structure of the PNG they are saved as.
+//
+// NOTES:
+//   The IDAT stream isn't inflated, its Adler-32 is checked against the
+//   filtered rows instead, so the test needs no zlib.
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRPlot.h"
+#include "WinMTRRaster.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static unsigned int GetU32(const unsigned char* p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static unsigned int Crc32(const unsigned char* data, size_t size)
+{
+    unsigned int crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+static unsigned int Adler32(const unsigned char* data, size_t size)
+{
+    unsigned int a = 1, b = 0;
+    for (size_t i = 0; i < size; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+// true if the pixel at x, y is the opaque color
+static bool PixelIs(const WinMTRRaster& raster, int x, int y, unsigned int color)
+{
+    const unsigned char* p = raster.Pixels() + ((size_t)y * raster.Width() + x) * 4;
+    return p[0] == ((color >> 16) & 0xFF) && p[1] == ((color >> 8) & 0xFF) && p[2] == (color & 0xFF) && p[3] == 255;
+}
+
+static void TestRaster()
+{
+    WinMTRRaster raster(64, 32);
+    CHECK(PixelIs(raster, 0, 0, CANVAS_RGB(0, 0, 0)));
+
+    raster.FillRect(8, 8, 16, 8, CANVAS_RGB(10, 20, 30));
+    CHECK(PixelIs(raster, 8, 8, CANVAS_RGB(10, 20, 30)));
+    CHECK(PixelIs(raster, 23, 15, CANVAS_RGB(10, 20, 30)));
+    CHECK(PixelIs(raster, 7, 8, CANVAS_RGB(0, 0, 0)));
+    CHECK(PixelIs(raster, 24, 16, CANVAS_RGB(0, 0, 0)));
+
+    // 3 pixels wide on the center of row 16, its middle row fully covered
+    raster.DrawLine(32, 16.5f, 60, 16.5f, 3.0f, CANVAS_RGB(255, 0, 0));
+    CHECK(PixelIs(raster, 45, 16, CANVAS_RGB(255, 0, 0)));
+    CHECK(PixelIs(raster, 45, 5, CANVAS_RGB(0, 0, 0)));
+    CHECK(PixelIs(raster, 45, 25, CANVAS_RGB(0, 0, 0)));
+
+    raster.SetClip(0, 0, 40, 32);
+    raster.FillRect(0, 0, 64, 4, CANVAS_RGB(0, 255, 0));
+    raster.ResetClip();
+    CHECK(PixelIs(raster, 39, 0, CANVAS_RGB(0, 255, 0)));
+    CHECK(PixelIs(raster, 40, 0, CANVAS_RGB(0, 0, 0)));
+}
+
+static void TestPNG()
+{
+    WinMTRRaster raster(37, 11);
+    raster.FillRect(0, 0, 37, 11, CANVAS_RGB(32, 64, 128));
+    raster.DrawLine(0, 0, 36, 10, 2.0f, CANVAS_RGB(255, 255, 255));
+    std::vector<unsigned char> png;
+    raster.EncodePNG(png);
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    CHECK(png.size() > 8 + 25 + 12 + 12);
+    if (png.size() <= 8 + 25 + 12 + 12) return;
+    CHECK(memcmp(&png[0], signature, 8) == 0);
+
+    // IHDR, IDAT and IEND, each with the CRC of its type and data
+    const char* types[3] = { "IHDR", "IDAT", "IEND" };
+    size_t at = 8;
+    for (int chunk = 0; chunk < 3; chunk++) {
+        CHECK(at + 12 <= png.size());
+        if (at + 12 > png.size()) return;
+        unsigned int length = GetU32(&png[at]);
+        CHECK(at + 12 + length <= png.size());
+        if (at + 12 + length > png.size()) return;
+        const unsigned char* data = &png[at + 8];
+        CHECK(memcmp(&png[at + 4], types[chunk], 4) == 0);
+        CHECK(Crc32(&png[at + 4], length + 4) == GetU32(data + length));
+
+        if (chunk == 0) {
+            CHECK(length == 13);
+            CHECK(GetU32(data) == 37);
+            CHECK(GetU32(data + 4) == 11);
+            CHECK(data[8] == 8 && data[9] == 6);
+        } else if (chunk == 1) {
+            // zlib header and the Adler-32 of the rows with the Up filter
+            CHECK(length > 6 && data[0] == 0x78 && (data[0] * 256 + data[1]) % 31 == 0);
+            size_t stride = (size_t)raster.Width() * 4;
+            std::vector<unsigned char> filtered;
+            for (int row = 0; row < raster.Height(); row++) {
+                const unsigned char* cur = raster.Pixels() + row * stride;
+                filtered.push_back(2);
+                for (size_t i = 0; i < stride; i++)
+                    filtered.push_back((unsigned char)(row ? cur[i] - cur[i - stride] : cur[i]));
+            }
+            CHECK(Adler32(&filtered[0], filtered.size()) == GetU32(data + length - 4));
+        } else {
+            CHECK(length == 0);
+        }
+        at += 12 + length;
+    }
+    CHECK(at == png.size());
+}
+
+static void TestPlot()
+{
+    WinMTRPlot plot;
+    int rtt[2] = { 5000, 0 };
+    const char* hostnames[2] = { "10.0.0.1", "" };
+    for (int i = 0; i < 10; i++) plot.AddSample(1000 * (i + 1), rtt, hostnames, 2);
+    CHECK(plot.Size() == 10);
+    CHECK(plot.SetTimeResolution(plot.Size()));
+
+    WinMTRRaster raster(400, 200);
+    plot.Draw(raster, raster.Width(), raster.Height());
+    CHECK(PixelIs(raster, 0, 0, PLOT_BACKGROUND));
+    CHECK(PixelIs(raster, raster.Width() - 1, raster.Height() - 1, PLOT_BACKGROUND));
+
+    // the one hop that answered is drawn in the first color, across the graph
+    const s_plotrect& graph = plot.GraphRect();
+    CHECK(graph.Width() > 0 && graph.Height() > 0);
+    int columns[3] = { graph.left + graph.Width() / 4, graph.left + graph.Width() / 2, graph.right - graph.Width() / 4 };
+    for (int c = 0; c < 3; c++) {
+        bool found = false;
+        for (int y = graph.top; y < graph.bottom && !found; y++)
+            found = PixelIs(raster, columns[c], y, CANVAS_RGB(0, 114, 189));
+        CHECK(found);
+    }
+}
+
+int main()
+{
+    TestRaster();
+    TestPNG();
+    TestPlot();
+    if (failures) fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}